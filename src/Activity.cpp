@@ -0,0 +1,85 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Tells quiet passages from speech and music as they're played.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Activity.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+static const float HYSTERESIS_DB = 6.0f;
+
+ActivityDetector::ActivityDetector(Stage *upstream, unsigned int chNum, unsigned int rate, double thresholdDb,
+    std::function<void()> onChange)
+    : Stage(upstream), m_chNum(chNum), m_blockFrames(std::max(20/*ms*/ * rate / 1000, 1u)),
+      m_holdFrames(300/*ms*/ * rate / 1000),
+      m_enter((float)std::pow(10.0, thresholdDb / 10.0)),
+      m_leave((float)std::pow(10.0, (thresholdDb + HYSTERESIS_DB) / 10.0)),
+      m_onChange(onChange)
+{
+    Reset();
+}
+
+void ActivityDetector::Reset()
+{
+    Stage::Reset();
+    std::fill(m_peak, m_peak + 4, 0.0f);
+    std::fill(m_sumSq, m_sumSq + 4, 0.0f);
+    m_frames = 0;
+    m_under = 0;
+    if (m_quiet.exchange(false) && m_onChange)
+        m_onChange();
+}
+
+void ActivityDetector::Judge()
+{
+    const float meanSq = (m_sumSq[0] + m_sumSq[1] + m_sumSq[2] + m_sumSq[3]) / (m_frames * m_chNum);
+    m_under = meanSq < m_enter ? m_under + m_frames : 0;
+    const bool quiet = m_quiet.load(std::memory_order_relaxed);
+    if ((!quiet && m_under >= m_holdFrames) || (quiet && meanSq > m_leave)) {
+        m_quiet.store(!quiet, std::memory_order_relaxed);
+        trace::Instant("quiet", !quiet);
+        if (m_onChange)
+            m_onChange();
+    }
+    std::fill(m_peak, m_peak + 4, 0.0f);
+    std::fill(m_sumSq, m_sumSq + 4, 0.0f);
+    m_frames = 0;
+}
+
+int ActivityDetector::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("ActivityDetector");
+    const int ret = m_upstream->Pull(out, frames);
+    if (ret <= 0)
+        return ret;
+
+    size_t done = 0;
+    while (done < (size_t)ret) {
+        const size_t n = std::min((size_t)ret - done, m_blockFrames - m_frames);
+        simd::PeakSumSq(out + done * m_chNum, n * m_chNum, m_peak, m_sumSq);
+        m_frames += n;
+        done += n;
+        if (m_frames == m_blockFrames)
+            Judge();
+    }
+    return ret;
+}
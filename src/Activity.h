@@ -0,0 +1,63 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Tells quiet passages from speech and music as they're played.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_ACTIVITY_H
+#define KPLAY_ACTIVITY_H
+
+#include "Pipeline.h"
+#include <atomic>
+#include <functional>
+
+// Measures the RMS of every channel together over 20 ms blocks. The input
+// turns quiet once it stays under thresholdDb for 300 ms, and active again
+// as soon as a block goes over thresholdDb + 6 dB, so that neither the
+// pauses within speech nor levels around the threshold flip it back and
+// forth. onChange is called on the pulling thread whenever it turns.
+class ActivityDetector : public Stage {
+public:
+    ActivityDetector(Stage *upstream, unsigned int chNum, unsigned int rate, double thresholdDb,
+        std::function<void()> onChange);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    bool Quiet() const
+    {
+        return m_quiet.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Judge();
+
+    const unsigned int m_chNum;
+    const size_t m_blockFrames;
+    const size_t m_holdFrames;
+    const float m_enter;                // mean square to turn quiet under
+    const float m_leave;                // mean square to turn active over
+    const std::function<void()> m_onChange;
+    float m_peak[4];
+    float m_sumSq[4];
+    size_t m_frames = 0;                // in the block
+    size_t m_under = 0;                 // frames under the threshold in a row
+    std::atomic<bool> m_quiet { false };
+};
+
+#endif
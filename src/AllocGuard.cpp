@@ -0,0 +1,211 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Catches heap allocations on the route's threads while playing.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "AllocGuard.h"
+
+#ifdef KPLAY_ALLOC_GUARD
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <execinfo.h>
+#include <new>
+
+namespace allocguard {
+
+static const unsigned int MAX_RECORDS = 16;
+static const int MAX_FRAMES = 24;
+
+struct Record {
+    size_t bytes;
+    int frames;
+    void *stack[MAX_FRAMES];
+};
+
+static std::atomic<bool> s_armed { false };
+static std::atomic<uint64_t> s_count { 0 };
+static Record s_records[MAX_RECORDS];
+static std::atomic<unsigned int> s_recorded { 0 };
+
+// Plain types only, so that touching them never allocates
+static thread_local unsigned int t_entries = 0;
+static thread_local bool t_inside = false;
+
+static void Check(size_t bytes)
+{
+    if (t_entries < 2 || t_inside || !s_armed.load(std::memory_order_relaxed))
+        return;
+    t_inside = true;
+    const uint64_t n = s_count++;
+    if (n < MAX_RECORDS) {
+        Record &rec = s_records[n];
+        rec.bytes = bytes;
+        rec.frames = backtrace(rec.stack, MAX_FRAMES);
+        ++s_recorded;
+    }
+    t_inside = false;
+}
+
+bool Available()
+{
+    return true;
+}
+
+void Arm()
+{
+    // backtrace() loads the unwinder the first time, which allocates
+    void *stack[4];
+    backtrace(stack, 4);
+    s_armed = true;
+}
+
+void Disarm()
+{
+    s_armed = false;
+}
+
+void EnterAudioThread()
+{
+    if (t_entries < 2)
+        ++t_entries;
+}
+
+uint64_t Count()
+{
+    return s_count.load();
+}
+
+std::string Report()
+{
+    std::string report = std::to_string(Count()) + " allocation(s) on the route's threads while playing";
+    const unsigned int recorded = s_recorded.load();
+    for (unsigned int i = 0; i < recorded; ++i) {
+        const Record &rec = s_records[i];
+        report += "\n#" + std::to_string(i + 1) + ": " + std::to_string(rec.bytes) + " bytes";
+        char **symbols = backtrace_symbols(rec.stack, rec.frames);
+        // Leave out Check() and the malloc() it's called from
+        for (int f = 2; symbols && f < rec.frames; ++f)
+            report += std::string("\n    ") + symbols[f];
+        free(symbols);
+    }
+    return report;
+}
+
+}
+
+#ifdef __GLIBC__
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    allocguard::Check(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    allocguard::Check(num * size);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocguard::Check(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    allocguard::Check(size);
+    return __libc_memalign(alignment, size);
+}
+
+}
+
+#else
+
+// Without glibc's entry points to forward to, only C++ allocations are caught
+
+void *operator new(size_t size)
+{
+    allocguard::Check(size);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+#endif
+
+#else
+
+namespace allocguard {
+
+bool Available()
+{
+    return false;
+}
+
+void Arm()
+{
+}
+
+void Disarm()
+{
+}
+
+void EnterAudioThread()
+{
+}
+
+uint64_t Count()
+{
+    return 0;
+}
+
+std::string Report()
+{
+    return "";
+}
+
+}
+
+#endif
@@ -0,0 +1,51 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Catches heap allocations on the route's threads while playing.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_ALLOCGUARD_H
+#define KPLAY_ALLOCGUARD_H
+
+#include <cstdint>
+#include <string>
+
+// Only built in with the KPLAY_ALLOC_GUARD CMake option, which puts kplay's
+// own malloc() in front of everyone's, plugins' included. An allocation is
+// recorded, with a backtrace, when the guard is armed and the thread making
+// it has entered the audio path before, which leaves each thread's first
+// pass through kplay's code to warm up. Without the option everything here
+// does nothing.
+namespace allocguard {
+
+bool Available();
+
+void Arm();
+void Disarm();
+
+// Called wherever a route thread comes into kplay's code
+void EnterAudioThread();
+
+uint64_t Count();
+
+// Every allocation caught, the first few with their backtraces
+std::string Report();
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * One pre-faulted, locked region for the pipeline's buffers.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Arena.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace arena {
+
+static const size_t ALIGNMENT = 64;
+
+std::atomic<bool> g_enabled { false };
+
+static std::mutex s_mutex;
+static char *s_base = nullptr;
+static size_t s_capacity = 0;
+static size_t s_used = 0;           // bytes handed out since the arena was last empty
+static size_t s_live = 0;           // buffers not freed yet
+static size_t s_touched = 0;        // bytes pre-faulted, and locked if s_locked
+static bool s_locked = false;
+static size_t s_peak = 0;
+static uint64_t s_allocations = 0;
+static uint64_t s_afterLock = 0;    // allocations since the last Lock()
+static uint64_t s_spills = 0;
+static size_t s_spilledBytes = 0;
+static std::atomic<uint64_t> s_faults { 0 };
+
+int Enable(size_t capacity, std::string *error)
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    if (s_base)
+        return 0;
+    void *p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        *error = std::string("can't map the arena: ") + strerror(errno);
+        return -1;
+    }
+    s_base = (char *)p;
+    s_capacity = capacity;
+    g_enabled = true;
+    return 0;
+}
+
+void *Allocate(size_t bytes)
+{
+    if (!Enabled())
+        return nullptr;
+    std::lock_guard<std::mutex> _l(s_mutex);
+    const size_t size = (std::max<size_t>(bytes, 1) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (s_capacity - s_used < size) {
+        ++s_spills;
+        s_spilledBytes += bytes;
+        return nullptr;
+    }
+    void *p = s_base + s_used;
+    s_used += size;
+    s_peak = std::max(s_peak, s_used);
+    ++s_live;
+    ++s_allocations;
+    ++s_afterLock;
+    return p;
+}
+
+bool Free(void *p)
+{
+    if (!Enabled() || (char *)p < s_base || (char *)p >= s_base + s_capacity)
+        return false;
+    std::lock_guard<std::mutex> _l(s_mutex);
+    if (--s_live == 0)
+        s_used = 0;     // the pages stay touched and locked for whatever comes next
+    return true;
+}
+
+int Lock(std::string *error)
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t end = (s_used + page - 1) / page * page;
+    s_afterLock = 0;
+    if (end <= s_touched)
+        return 0;
+
+    // Writing rather than reading, or the zero page would be mapped in
+    for (size_t offset = s_touched; offset < end; offset += page)
+        ((volatile char *)s_base)[offset] = 0;
+    const size_t from = s_touched;
+    s_touched = end;
+    if (mlock(s_base + from, end - from) < 0) {
+        const int err = errno;
+        *error = std::string("can't lock the arena: ") + strerror(err);
+        if (err == ENOMEM || err == EPERM)
+            *error += " (raise the memlock limit with ulimit -l or in /etc/security/limits.conf)";
+        s_locked = false;
+        return -1;
+    }
+    s_locked = from == 0 || s_locked;
+    return 0;
+}
+
+uint64_t ThreadFaults()
+{
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+        return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+#endif
+    return 0;
+}
+
+void CountFaults(uint64_t faults)
+{
+    s_faults += faults;
+}
+
+std::string Report()
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+        "Footprint:        %.1f KiB at most, of %zu MiB reserved\n"
+        "Pre-faulted:      %.1f KiB, %s\n"
+        "Buffers:          %llu, %llu of them after the last lock\n"
+        "Spilled to heap:  %llu buffers, %.1f KiB\n"
+        "Page faults in steady state: %llu",
+        s_peak / 1024.0, s_capacity >> 20,
+        s_touched / 1024.0, s_locked ? "locked" : "not locked",
+        (unsigned long long)s_allocations, (unsigned long long)s_afterLock,
+        (unsigned long long)s_spills, s_spilledBytes / 1024.0,
+        (unsigned long long)s_faults.load());
+    return buf;
+}
+
+}
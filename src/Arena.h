@@ -0,0 +1,105 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * One pre-faulted, locked region for the pipeline's buffers.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_ARENA_H
+#define KPLAY_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+// Buffers are handed out one after another from a single mapping and only
+// come back all together, once every one of them has been freed, e.g. when a
+// pipeline is torn down for the next file. Whatever doesn't fit goes to the
+// heap and is counted. Until Enable(), everything goes to the heap.
+namespace arena {
+
+extern std::atomic<bool> g_enabled;
+
+inline bool Enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Reserves capacity bytes of address space, which costs no memory until used
+int Enable(size_t capacity, std::string *error);
+
+// 64-byte aligned, nullptr if the arena isn't enabled or is full
+void *Allocate(size_t bytes);
+// Returns false if p isn't from the arena
+bool Free(void *p);
+
+// Touches every page handed out so far and locks them into memory,
+// describing why they couldn't be locked in error
+int Lock(std::string *error);
+
+// Minor and major page faults of the calling thread so far, 0 where unknown
+uint64_t ThreadFaults();
+// Adds page faults taken while the route was running steadily
+void CountFaults(uint64_t faults);
+
+// Footprint, locking, heap spills and steady-state page faults
+std::string Report();
+
+}
+
+// Puts a container's elements in the arena when it's enabled
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() { }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &) { }
+
+    T *allocate(size_t n)
+    {
+        void *p = arena::Allocate(n * sizeof(T));
+        return (T *)(p ? p : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t)
+    {
+        if (!arena::Free(p))
+            ::operator delete(p);
+    }
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &)
+{
+    return false;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
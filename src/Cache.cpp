@@ -0,0 +1,91 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-file analysis results cached across runs.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Cache.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace cache {
+
+static const size_t HASHED_BYTES = 64 << 10;    // at each end of the file
+
+static uint64_t Fnv1a(uint64_t h, const void *data, size_t bytes)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < bytes; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::string Key(const char *fileName)
+{
+    struct stat st;
+    if (stat(fileName, &st) != 0 || !S_ISREG(st.st_mode))
+        return "";
+
+    FILE *f = fopen(fileName, "rb");
+    if (!f)
+        return "";
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    const uint64_t size = st.st_size;
+    const int64_t mtime = st.st_mtime;
+    h = Fnv1a(h, &size, sizeof(size));
+    h = Fnv1a(h, &mtime, sizeof(mtime));
+
+    // On the heap, as Key() runs on several threads at once
+    std::string buf(HASHED_BYTES, '\0');
+    size_t n = fread(&buf[0], 1, buf.size(), f);
+    h = Fnv1a(h, buf.data(), n);
+    if (size > 2 * HASHED_BYTES && fseek(f, -(long)HASHED_BYTES, SEEK_END) == 0) {
+        n = fread(&buf[0], 1, buf.size(), f);
+        h = Fnv1a(h, buf.data(), n);
+    }
+    fclose(f);
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+    return key;
+}
+
+std::string Path(const std::string &key, const char *suffix)
+{
+    std::string dir;
+    const char *env = getenv("XDG_CACHE_HOME");
+    if (env && *env) {
+        dir = env;
+    } else {
+        env = getenv("HOME");
+        if (!env || !*env)
+            return "";
+        dir = std::string(env) + "/.cache";
+        mkdir(dir.c_str(), 0755);
+    }
+    dir += "/kplay";
+    mkdir(dir.c_str(), 0755);
+    return dir + "/" + key + suffix;
+}
+
+}
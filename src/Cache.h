@@ -0,0 +1,40 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-file analysis results cached across runs.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_CACHE_H
+#define KPLAY_CACHE_H
+
+#include <string>
+
+namespace cache {
+
+// Returns a key that changes whenever the file does, or "" if the file
+// can't be read. It's built from the size, the mtime and a hash of the
+// file's head and tail, so it's cheap even for multi-hour files.
+std::string Key(const char *fileName);
+
+// Returns the path of the cache entry for key and suffix under
+// $XDG_CACHE_HOME/kplay (or ~/.cache/kplay), or "" if there is no cache directory
+std::string Path(const std::string &key, const char *suffix);
+
+}
+
+#endif
@@ -0,0 +1,217 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Compressed audio encoders used by FileSink.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Encoder.h"
+#include <chrono>
+#ifdef KPLAY_HAVE_FLAC
+#include <FLAC/stream_encoder.h>
+#endif
+#ifdef KPLAY_HAVE_OPUS
+#include <opus/opusenc.h>
+#endif
+
+#ifdef KPLAY_HAVE_FLAC
+class FlacEncoder : public Encoder {
+public:
+    FlacEncoder(unsigned int chNum, unsigned int bitsPerSample, unsigned int rate)
+        : Encoder(chNum, bitsPerSample, rate) { }
+
+    virtual ~FlacEncoder()
+    {
+        if (m_enc) {
+            Finish();
+            FLAC__stream_encoder_delete(m_enc);
+        }
+    }
+
+    int Open(const char *fileName)
+    {
+        m_enc = FLAC__stream_encoder_new();
+        if (!m_enc)
+            return -1;
+        FLAC__stream_encoder_set_channels(m_enc, m_chNum);
+        FLAC__stream_encoder_set_bits_per_sample(m_enc, m_bitsPerSample);
+        FLAC__stream_encoder_set_sample_rate(m_enc, m_rate);
+        FLAC__stream_encoder_set_compression_level(m_enc, 5);
+        if (FLAC__stream_encoder_init_file(m_enc, fileName, nullptr, nullptr) != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+            return -1;
+        m_open = true;
+        return 0;
+    }
+
+    virtual int Finish() override
+    {
+        if (!m_open)
+            return 0;
+        m_open = false;
+        return FLAC__stream_encoder_finish(m_enc) ? 0 : -1;
+    }
+
+private:
+    virtual int EncodeInt(const int32_t *samples, size_t frames) override
+    {
+        return FLAC__stream_encoder_process_interleaved(m_enc, samples, frames) ? 0 : -1;
+    }
+
+    FLAC__StreamEncoder *m_enc = nullptr;
+    bool m_open = false;
+};
+#endif
+
+#ifdef KPLAY_HAVE_OPUS
+class OpusFileEncoder : public Encoder {
+public:
+    OpusFileEncoder(unsigned int chNum, unsigned int bitsPerSample, unsigned int rate)
+        : Encoder(chNum, bitsPerSample, rate) { }
+
+    virtual ~OpusFileEncoder()
+    {
+        Finish();
+        if (m_comments)
+            ope_comments_destroy(m_comments);
+    }
+
+    int Open(const char *fileName)
+    {
+        m_comments = ope_comments_create();
+        if (!m_comments)
+            return -1;
+        ope_comments_add(m_comments, "ENCODER", "kplay");
+        int err = 0;
+        // libopusenc resamples to 48 kHz internally if needed
+        m_enc = ope_encoder_create_file(fileName, m_comments, m_rate, m_chNum, 0, &err);
+        if (!m_enc)
+            return -1;
+        ope_encoder_ctl(m_enc, OPUS_SET_BITRATE(64000 * m_chNum));
+        return 0;
+    }
+
+    virtual int Finish() override
+    {
+        if (!m_enc)
+            return 0;
+        int ret = ope_encoder_drain(m_enc);
+        ope_encoder_destroy(m_enc);
+        m_enc = nullptr;
+        return ret == OPE_OK ? 0 : -1;
+    }
+
+    virtual bool TakesFloat() const override
+    {
+        return true;
+    }
+
+private:
+    virtual int EncodeFloat(const float *samples, size_t frames) override
+    {
+        return ope_encoder_write_float(m_enc, samples, frames) == OPE_OK ? 0 : -1;
+    }
+
+    OggOpusComments *m_comments = nullptr;
+    OggOpusEnc *m_enc = nullptr;
+};
+#endif
+
+bool Encoder::Available(Codec codec)
+{
+    switch (codec) {
+#ifdef KPLAY_HAVE_FLAC
+    case FLAC:
+        return true;
+#endif
+#ifdef KPLAY_HAVE_OPUS
+    case OPUS:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Encoder *Encoder::Create(Codec codec, const char *fileName, unsigned int chNum, unsigned int bitsPerSample, unsigned int rate)
+{
+    if (bitsPerSample > MaxBitsPerSample(codec))
+        return nullptr;
+    switch (codec) {
+#ifdef KPLAY_HAVE_FLAC
+    case FLAC: {
+        FlacEncoder *enc = new FlacEncoder(chNum, bitsPerSample, rate);
+        if (enc->Open(fileName) < 0) {
+            delete enc;
+            return nullptr;
+        }
+        return enc;
+    }
+#endif
+#ifdef KPLAY_HAVE_OPUS
+    case OPUS: {
+        OpusFileEncoder *enc = new OpusFileEncoder(chNum, bitsPerSample, rate);
+        if (enc->Open(fileName) < 0) {
+            delete enc;
+            return nullptr;
+        }
+        return enc;
+    }
+#endif
+    default:
+        (void)fileName;
+        (void)chNum;
+        (void)bitsPerSample;
+        (void)rate;
+        return nullptr;
+    }
+}
+
+int Encoder::Encode(const void *pcm, size_t frames)
+{
+    const auto start = std::chrono::steady_clock::now();
+    if (TakesFloat()) {
+        int ret = EncodeFloat((const float *)pcm, frames);
+        m_frames += frames;
+        m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return ret;
+    }
+
+    // Both libraries take samples widened to 32-bit integers
+    const size_t n = frames * m_chNum;
+    if (m_samples.size() < n)
+        m_samples.resize(n);
+    const uint8_t *p = (const uint8_t *)pcm;
+    switch (m_bitsPerSample) {
+    case 16:
+        for (size_t i = 0; i < n; ++i)
+            m_samples[i] = (int16_t)(p[2 * i] | p[2 * i + 1] << 8);
+        break;
+    case 24:
+        for (size_t i = 0; i < n; ++i)
+            m_samples[i] = (int32_t)((uint32_t)p[3 * i] << 8 | (uint32_t)p[3 * i + 1] << 16 | (uint32_t)p[3 * i + 2] << 24) >> 8;
+        break;
+    default:
+        for (size_t i = 0; i < n; ++i)
+            m_samples[i] = (int32_t)((uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 | (uint32_t)p[4 * i + 2] << 16 | (uint32_t)p[4 * i + 3] << 24);
+        break;
+    }
+    int ret = EncodeInt(m_samples.data(), frames);
+
+    m_frames += frames;
+    m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ret;
+}
@@ -0,0 +1,94 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Compressed audio encoders used by FileSink.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_ENCODER_H
+#define KPLAY_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encodes audio into a compressed file, either packed little-endian integer
+// PCM or, for encoders that TakeFloat(), float frames as they are
+class Encoder {
+public:
+    enum Codec { FLAC, OPUS };
+
+    // Returns nullptr if the codec isn't built in, can't take bitsPerSample or
+    // the file can't be created
+    static Encoder *Create(Codec codec, const char *fileName, unsigned int chNum, unsigned int bitsPerSample, unsigned int rate);
+    static bool Available(Codec codec);
+
+    virtual ~Encoder() { }
+
+    // FLAC is lossless at the file's bit depth, Opus codes float itself
+    static unsigned int MaxBitsPerSample(Codec codec)
+    {
+        return codec == FLAC ? 24 : 32;
+    }
+
+    virtual bool TakesFloat() const
+    {
+        return false;
+    }
+
+    // pcm is float frames if TakesFloat(), integer PCM otherwise
+    int Encode(const void *pcm, size_t frames);
+    virtual int Finish() = 0;
+
+    // Frames encoded so far, and the wall time spent encoding them
+    uint64_t Frames() const
+    {
+        return m_frames;
+    }
+    double Seconds() const
+    {
+        return m_seconds;
+    }
+
+protected:
+    Encoder(unsigned int chNum, unsigned int bitsPerSample, unsigned int rate)
+        : m_chNum(chNum), m_bitsPerSample(bitsPerSample), m_rate(rate) { }
+
+    virtual int EncodeInt(const int32_t *samples, size_t frames)
+    {
+        (void)samples;
+        (void)frames;
+        return -1;
+    }
+    virtual int EncodeFloat(const float *samples, size_t frames)
+    {
+        (void)samples;
+        (void)frames;
+        return -1;
+    }
+
+    const unsigned int m_chNum;
+    const unsigned int m_bitsPerSample;
+    const unsigned int m_rate;
+
+private:
+    std::vector<int32_t> m_samples;
+    uint64_t m_frames = 0;
+    double m_seconds = 0.0;
+};
+
+#endif
@@ -0,0 +1,311 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Parametric equalizer built of cascaded biquads.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Equalizer.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static const struct {
+    const char *name;
+    EqBand::Type type;
+} s_types[] = {
+    { "peak", EqBand::PEAK },
+    { "lowshelf", EqBand::LOWSHELF },
+    { "highshelf", EqBand::HIGHSHELF },
+    { "lowpass", EqBand::LOWPASS },
+    { "highpass", EqBand::HIGHPASS },
+    { "notch", EqBand::NOTCH },
+};
+
+Equalizer::Equalizer(Stage *upstream, unsigned int chNum, unsigned int rate)
+    : Stage(upstream), m_chNum(chNum), m_rate(rate), m_groups((chNum + 3) / 4),
+      m_rampSteps(std::max(20/*ms*/ * rate / 1000 / RAMP_BLOCK, 1u)),
+      m_state(m_groups * MAX_BANDS * 2 * 4, 0.0f), m_lanes(RAMP_BLOCK * 4, 0.0f)
+{
+    for (unsigned int b = 0; b < MAX_BANDS; ++b)
+        m_cur[b] = m_target[b] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+}
+
+void Equalizer::SetBands(const std::vector<EqBand> &bands)
+{
+    std::lock_guard<std::mutex> _l(m_mutex);
+    m_bandCount = (unsigned int)std::min(bands.size(), (size_t)MAX_BANDS);
+    std::copy(bands.begin(), bands.begin() + m_bandCount, m_bands);
+    m_changed = true;
+}
+
+void Equalizer::SetBypass(bool bypass)
+{
+    std::lock_guard<std::mutex> _l(m_mutex);
+    m_bypass = bypass;
+    m_changed = true;
+}
+
+// RBJ Audio EQ Cookbook
+static void Design(const EqBand &band, unsigned int rate, double c[5])
+{
+    const double A = std::pow(10.0, band.gainDb / 40.0);
+    const double w0 = 2.0 * M_PI * band.freq / rate;
+    const double cs = std::cos(w0);
+    const double alpha = std::sin(w0) / (2.0 * band.q);
+    const double sq = 2.0 * std::sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (band.type) {
+    case EqBand::PEAK:
+        b0 = 1.0 + alpha * A;
+        b1 = -2.0 * cs;
+        b2 = 1.0 - alpha * A;
+        a0 = 1.0 + alpha / A;
+        a1 = -2.0 * cs;
+        a2 = 1.0 - alpha / A;
+        break;
+    case EqBand::LOWSHELF:
+        b0 = A * ((A + 1.0) - (A - 1.0) * cs + sq);
+        b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cs);
+        b2 = A * ((A + 1.0) - (A - 1.0) * cs - sq);
+        a0 = (A + 1.0) + (A - 1.0) * cs + sq;
+        a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cs);
+        a2 = (A + 1.0) + (A - 1.0) * cs - sq;
+        break;
+    case EqBand::HIGHSHELF:
+        b0 = A * ((A + 1.0) + (A - 1.0) * cs + sq);
+        b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cs);
+        b2 = A * ((A + 1.0) + (A - 1.0) * cs - sq);
+        a0 = (A + 1.0) - (A - 1.0) * cs + sq;
+        a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cs);
+        a2 = (A + 1.0) - (A - 1.0) * cs - sq;
+        break;
+    case EqBand::LOWPASS:
+        b0 = (1.0 - cs) / 2.0;
+        b1 = 1.0 - cs;
+        b2 = (1.0 - cs) / 2.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cs;
+        a2 = 1.0 - alpha;
+        break;
+    case EqBand::HIGHPASS:
+        b0 = (1.0 + cs) / 2.0;
+        b1 = -(1.0 + cs);
+        b2 = (1.0 + cs) / 2.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cs;
+        a2 = 1.0 - alpha;
+        break;
+    case EqBand::NOTCH:
+    default:
+        b0 = 1.0;
+        b1 = -2.0 * cs;
+        b2 = 1.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cs;
+        a2 = 1.0 - alpha;
+        break;
+    }
+    c[0] = b0 / a0;
+    c[1] = b1 / a0;
+    c[2] = b2 / a0;
+    c[3] = a1 / a0;
+    c[4] = a2 / a0;
+}
+
+void Equalizer::Retarget()
+{
+    EqBand bands[MAX_BANDS];
+    unsigned int n = 0;
+    {
+        std::lock_guard<std::mutex> _l(m_mutex);
+        if (!m_bypass) {
+            n = m_bandCount;
+            std::copy(m_bands, m_bands + n, bands);
+        }
+        m_changed = false;
+    }
+
+    for (unsigned int b = 0; b < MAX_BANDS; ++b) {
+        if (b < n) {
+            double c[5];
+            Design(bands[b], m_rate, c);
+            m_target[b] = { (float)c[0], (float)c[1], (float)c[2], (float)c[3], (float)c[4] };
+        } else {
+            m_target[b] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        }
+        m_delta[b].b0 = (m_target[b].b0 - m_cur[b].b0) / m_rampSteps;
+        m_delta[b].b1 = (m_target[b].b1 - m_cur[b].b1) / m_rampSteps;
+        m_delta[b].b2 = (m_target[b].b2 - m_cur[b].b2) / m_rampSteps;
+        m_delta[b].a1 = (m_target[b].a1 - m_cur[b].a1) / m_rampSteps;
+        m_delta[b].a2 = (m_target[b].a2 - m_cur[b].a2) / m_rampSteps;
+    }
+    m_active = std::max(m_active, n);
+    m_rampLeft = m_rampSteps;
+}
+
+void Equalizer::Step()
+{
+    if (m_rampLeft == 0)
+        return;
+
+    if (--m_rampLeft > 0) {
+        for (unsigned int b = 0; b < m_active; ++b) {
+            m_cur[b].b0 += m_delta[b].b0;
+            m_cur[b].b1 += m_delta[b].b1;
+            m_cur[b].b2 += m_delta[b].b2;
+            m_cur[b].a1 += m_delta[b].a1;
+            m_cur[b].a2 += m_delta[b].a2;
+        }
+        return;
+    }
+
+    // Land exactly on the target and stop running the bands that became identity
+    for (unsigned int b = 0; b < m_active; ++b)
+        m_cur[b] = m_target[b];
+    while (m_active > 0) {
+        const Coefs &c = m_cur[m_active - 1];
+        if (c.b0 != 1.0f || c.b1 != 0.0f || c.b2 != 0.0f || c.a1 != 0.0f || c.a2 != 0.0f)
+            break;
+        --m_active;
+        for (unsigned int g = 0; g < m_groups; ++g)
+            std::fill_n(&m_state[(g * MAX_BANDS + m_active) * 8], 8, 0.0f);
+    }
+}
+
+void Equalizer::Reset()
+{
+    Stage::Reset();
+    if (m_changed)
+        Retarget();
+    m_rampLeft = std::min(m_rampLeft, 1u);
+    Step();
+    std::fill(m_state.begin(), m_state.end(), 0.0f);
+}
+
+int Equalizer::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("Equalizer");
+    int ret = m_upstream->Pull(out, frames);
+    if (ret <= 0)
+        return ret;
+
+    if (m_changed)
+        Retarget();
+
+    for (int start = 0; start < ret && (m_active > 0 || m_rampLeft > 0); start += RAMP_BLOCK) {
+        const int n = std::min<int>(RAMP_BLOCK, ret - start);
+        Step();
+
+        for (unsigned int g = 0; g < m_groups; ++g) {
+            const unsigned int ch0 = g * 4;
+            const unsigned int lanes = std::min(m_chNum - ch0, 4u);
+            float *frame = out + (size_t)start * m_chNum + ch0;
+            for (int i = 0; i < n; ++i)
+                memcpy(&m_lanes[i * 4], frame + (size_t)i * m_chNum, lanes * sizeof(float));
+
+            // Transposed direct form II, one band at a time over the whole block
+            for (unsigned int b = 0; b < m_active; ++b) {
+                const simd::F4 b0 = simd::Set1(m_cur[b].b0);
+                const simd::F4 b1 = simd::Set1(m_cur[b].b1);
+                const simd::F4 b2 = simd::Set1(m_cur[b].b2);
+                const simd::F4 a1 = simd::Set1(m_cur[b].a1);
+                const simd::F4 a2 = simd::Set1(m_cur[b].a2);
+                float *state = &m_state[(g * MAX_BANDS + b) * 8];
+                simd::F4 s1 = simd::Load(state);
+                simd::F4 s2 = simd::Load(state + 4);
+                for (int i = 0; i < n; ++i) {
+                    const simd::F4 x = simd::Load(&m_lanes[i * 4]);
+                    const simd::F4 y = simd::Add(simd::Mul(b0, x), s1);
+                    s1 = simd::Add(simd::Sub(simd::Mul(b1, x), simd::Mul(a1, y)), s2);
+                    s2 = simd::Sub(simd::Mul(b2, x), simd::Mul(a2, y));
+                    simd::Store(&m_lanes[i * 4], y);
+                }
+                simd::Store(state, s1);
+                simd::Store(state + 4, s2);
+
+                // Keep decaying states out of the slow denormal range
+                for (int k = 0; k < 8; ++k) {
+                    if (std::fabs(state[k]) < 1e-30f)
+                        state[k] = 0.0f;
+                }
+            }
+
+            for (int i = 0; i < n; ++i)
+                memcpy(frame + (size_t)i * m_chNum, &m_lanes[i * 4], lanes * sizeof(float));
+        }
+    }
+    return ret;
+}
+
+int Equalizer::Parse(const char *spec, unsigned int rate, std::vector<EqBand> *bands)
+{
+    bands->clear();
+
+    std::string text(spec);
+    std::replace(text.begin(), text.end(), ',', '\n');
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::replace(line.begin(), line.end(), ':', ' ');
+
+        std::istringstream fields(line);
+        std::string name;
+        EqBand band = { EqBand::PEAK, 0.0, 0.0, M_SQRT1_2 };
+        fields >> name >> band.freq;
+        if (!fields)
+            return -1;
+        if (!(fields >> band.gainDb))
+            band.gainDb = 0.0;
+        else if (!(fields >> band.q))
+            band.q = M_SQRT1_2;
+
+        unsigned int t = 0;
+        for (; t < sizeof(s_types) / sizeof(s_types[0]); ++t) {
+            if (name == s_types[t].name)
+                break;
+        }
+        if (t == sizeof(s_types) / sizeof(s_types[0]))
+            return -1;
+        band.type = s_types[t].type;
+
+        if (band.freq <= 0.0 || band.freq >= rate / 2.0 || band.q <= 0.0 || std::fabs(band.gainDb) > 30.0)
+            return -1;
+        if (bands->size() == MAX_BANDS)
+            return -1;
+        bands->push_back(band);
+    }
+    return 0;
+}
+
+int Equalizer::Load(const char *fileName, unsigned int rate, std::vector<EqBand> *bands)
+{
+    std::ifstream fin(fileName);
+    if (!fin)
+        return -1;
+    std::stringstream text;
+    text << fin.rdbuf();
+    return Parse(text.str().c_str(), rate, bands);
+}
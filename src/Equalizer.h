@@ -0,0 +1,99 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Parametric equalizer built of cascaded biquads.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_EQUALIZER_H
+#define KPLAY_EQUALIZER_H
+
+#include "Pipeline.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct EqBand {
+    enum Type { PEAK, LOWSHELF, HIGHSHELF, LOWPASS, HIGHPASS, NOTCH };
+    Type type;
+    double freq;    // Hz
+    double gainDb;  // PEAK and shelves only
+    double q;
+};
+
+// Applies the same bands to every channel, up to four channels per SIMD lane group.
+// New bands and bypassing take effect by ramping the coefficients over 20 ms,
+// which keeps every step stable since the stable region of (a1, a2) is convex.
+class Equalizer : public Stage {
+public:
+    enum { MAX_BANDS = 16 };
+
+    Equalizer(Stage *upstream, unsigned int chNum, unsigned int rate);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    unsigned int Rate() const
+    {
+        return m_rate;
+    }
+
+    // Both can be called from any thread while playing
+    void SetBands(const std::vector<EqBand> &bands);
+    void SetBypass(bool bypass);
+
+    // Parses bands separated by ',' or new lines, each one TYPE:FREQ[:GAIN[:Q]]
+    // with TYPE one of peak|lowshelf|highshelf|lowpass|highpass|notch,
+    // e.g. "lowshelf:120:-3,peak:2500:2:1.4". Lines starting with '#' are ignored.
+    static int Parse(const char *spec, unsigned int rate, std::vector<EqBand> *bands);
+    static int Load(const char *fileName, unsigned int rate, std::vector<EqBand> *bands);
+
+private:
+    enum {
+        RAMP_BLOCK = 32     // frames between coefficient steps
+    };
+
+    struct Coefs {
+        float b0, b1, b2, a1, a2;
+    };
+
+    void Retarget();
+    void Step();
+
+    const unsigned int m_chNum;
+    const unsigned int m_rate;
+    const unsigned int m_groups;        // of four channels
+    const unsigned int m_rampSteps;
+
+    // Fixed in size, so that neither SetBands() nor Retarget() on the route thread allocates
+    std::mutex m_mutex;                 // guards m_bands, m_bandCount and m_bypass
+    EqBand m_bands[MAX_BANDS];
+    unsigned int m_bandCount = 0;
+    bool m_bypass = false;
+    std::atomic<bool> m_changed { false };
+
+    Coefs m_cur[MAX_BANDS];
+    Coefs m_delta[MAX_BANDS];
+    Coefs m_target[MAX_BANDS];
+    unsigned int m_rampLeft = 0;
+    unsigned int m_active = 0;          // bands being run, the ones past it are identity
+
+    ArenaVector<float> m_state;         // s1 and s2 lanes per group and band
+    ArenaVector<float> m_lanes;         // RAMP_BLOCK frames of one group
+};
+
+#endif
@@ -0,0 +1,104 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Real FFT of power-of-two sizes.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Fft.h"
+#include <cmath>
+#include <utility>
+
+typedef std::complex<float> cfloat;
+
+Fft::Fft(unsigned int n)
+    : m_n(n), m_bitrev(n / 2), m_twiddle(n / 4), m_split(n / 2 + 1), m_work(n / 2)
+{
+    const unsigned int m = n / 2;
+    unsigned int bits = 0;
+    while ((1u << bits) < m)
+        ++bits;
+    for (unsigned int i = 0; i < m; ++i) {
+        unsigned int r = 0;
+        for (unsigned int b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_bitrev[i] = r;
+    }
+    for (unsigned int k = 0; k < m / 2; ++k)
+        m_twiddle[k] = std::polar(1.0, -2.0 * M_PI * k / m);
+    for (unsigned int k = 0; k <= m; ++k)
+        m_split[k] = std::polar(1.0, -2.0 * M_PI * k / n);
+}
+
+// Iterative radix-2, decimation in time
+void Fft::Transform(cfloat *data, bool inverse)
+{
+    const unsigned int m = m_n / 2;
+    for (unsigned int i = 0; i < m; ++i) {
+        if (i < m_bitrev[i])
+            std::swap(data[i], data[m_bitrev[i]]);
+    }
+    for (unsigned int len = 2; len <= m; len <<= 1) {
+        const unsigned int half = len / 2;
+        const unsigned int step = m / len;
+        for (unsigned int i = 0; i < m; i += len) {
+            for (unsigned int j = 0; j < half; ++j) {
+                const cfloat w = inverse ? std::conj(m_twiddle[j * step]) : m_twiddle[j * step];
+                const cfloat t = w * data[i + j + half];
+                data[i + j + half] = data[i + j] - t;
+                data[i + j] += t;
+            }
+        }
+    }
+}
+
+void Fft::Forward(const float *in, cfloat *out)
+{
+    // Pack even samples as real and odd ones as imaginary parts
+    const unsigned int m = m_n / 2;
+    for (unsigned int k = 0; k < m; ++k)
+        m_work[k] = cfloat(in[2 * k], in[2 * k + 1]);
+    Transform(m_work.data(), false);
+
+    // and split the two interleaved spectra apart
+    for (unsigned int k = 0; k <= m; ++k) {
+        const cfloat z = m_work[k % m];
+        const cfloat zc = std::conj(m_work[(m - k) % m]);
+        const cfloat even = 0.5f * (z + zc);
+        const cfloat odd = cfloat(0.0f, -0.5f) * (z - zc);
+        out[k] = even + m_split[k] * odd;
+    }
+}
+
+void Fft::Inverse(const cfloat *in, float *out)
+{
+    const unsigned int m = m_n / 2;
+    for (unsigned int k = 0; k < m; ++k) {
+        const cfloat x = in[k];
+        const cfloat xc = std::conj(in[m - k]);
+        const cfloat even = 0.5f * (x + xc);
+        const cfloat odd = 0.5f * (x - xc) * std::conj(m_split[k]);
+        m_work[k] = even + cfloat(0.0f, 1.0f) * odd;
+    }
+    Transform(m_work.data(), true);
+
+    const float scale = 1.0f / m;
+    for (unsigned int k = 0; k < m; ++k) {
+        out[2 * k] = m_work[k].real() * scale;
+        out[2 * k + 1] = m_work[k].imag() * scale;
+    }
+}
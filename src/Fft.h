@@ -0,0 +1,56 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Real FFT of power-of-two sizes.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_FFT_H
+#define KPLAY_FFT_H
+
+#include "Arena.h"
+#include <complex>
+#include <vector>
+
+// Transforms n real samples through one complex FFT of n / 2 points.
+// Tables are built once in the constructor, so transforms don't allocate.
+class Fft {
+public:
+    explicit Fft(unsigned int n);
+
+    unsigned int Size() const
+    {
+        return m_n;
+    }
+
+    // in has n samples, out gets the n / 2 + 1 non-negative frequency bins
+    void Forward(const float *in, std::complex<float> *out);
+
+    // in has n / 2 + 1 bins, out gets n samples, Inverse(Forward(x)) gives x back
+    void Inverse(const std::complex<float> *in, float *out);
+
+private:
+    void Transform(std::complex<float> *data, bool inverse);
+
+    const unsigned int m_n;
+    ArenaVector<unsigned int> m_bitrev;             // of the n / 2 points
+    ArenaVector<std::complex<float>> m_twiddle;     // e^(-2 pi i k / (n / 2))
+    ArenaVector<std::complex<float>> m_split;       // e^(-2 pi i k / n)
+    ArenaVector<std::complex<float>> m_work;
+};
+
+#endif
@@ -0,0 +1,343 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * The sink that RouteA's stream-out blocks write the audio files through.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "FileSink.h"
+#include "AllocGuard.h"
+#include "Realtime.h"
+#include "Trace.h"
+#include "WavFormat.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// Written through stdio in large blocks so that the route thread
+// rarely ends up in a write syscall
+static const size_t FILE_BUFFER_SIZE = 1 << 20;
+
+// The writer thread writes once this much is queued, or at least every WRITER_MAX_DELAY
+static const size_t WRITER_BATCH_SIZE = 256 << 10;
+static const std::chrono::milliseconds WRITER_MAX_DELAY(100);
+static const std::chrono::milliseconds WRITER_POLL_PERIOD(10);
+
+// RIFF/WAVE + JUNK + fmt + data. The JUNK chunk reserves the room
+// that a ds64 chunk needs if the file grows beyond 4 GB (RF64, EBU Tech 3306).
+static const size_t WAV_HEADER_SIZE = 12 + 8 + 28 + 8 + 16 + 8;
+
+static inline void Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void Put32(uint8_t *p, uint32_t v)
+{
+    Put16(p, (uint16_t)v);
+    Put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline void Put64(uint8_t *p, uint64_t v)
+{
+    Put32(p, (uint32_t)v);
+    Put32(p + 4, (uint32_t)(v >> 32));
+}
+
+FileSink::FileSink(unsigned int chNum, unsigned int bitsPerSample, unsigned int rate,
+                   Requantizer::Dither dither, Container container)
+    : m_chNum(chNum), m_bitsPerSample(bitsPerSample), m_rate(rate), m_container(container),
+      m_requantizer(chNum, bitsPerSample, dither)
+{
+}
+
+FileSink::~FileSink()
+{
+    Close();
+}
+
+int FileSink::ParseContainer(const char *str, Container *container)
+{
+    if (strcmp(str, "raw") == 0) {
+        *container = RAW;
+    } else if (strcmp(str, "wav") == 0) {
+        *container = WAV;
+    } else if (strcmp(str, "flac") == 0) {
+        *container = FLAC;
+    } else if (strcmp(str, "opus") == 0) {
+        *container = OPUS;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int FileSink::ParseFsync(const char *str, int *policy)
+{
+    if (strcmp(str, "none") == 0) {
+        *policy = FSYNC_NONE;
+    } else if (strcmp(str, "close") == 0) {
+        *policy = FSYNC_ON_CLOSE;
+    } else {
+        int period = atoi(str);
+        if (period <= 0)
+            return -1;
+        *policy = period;
+    }
+    return 0;
+}
+
+void FileSink::SetAsync(double bufferSeconds, bool dropWhenFull)
+{
+    m_bufferSeconds = bufferSeconds;
+    m_dropWhenFull = dropWhenFull;
+}
+
+int FileSink::Open(const char *fileName)
+{
+    if (IsCompressed(m_container)) {
+        m_encoder.reset(Encoder::Create(m_container == FLAC ? Encoder::FLAC : Encoder::OPUS,
+                                        fileName, m_chNum, m_bitsPerSample, m_rate));
+        if (!m_encoder)
+            return -1;
+        m_float = m_encoder->TakesFloat();
+    } else if (strcmp(fileName, "--") == 0) {
+        m_file = stdout;
+    } else {
+        m_file = fopen(fileName, "wb");
+        if (!m_file)
+            return -1;
+    }
+    if (m_file && m_file != stdout) {
+        m_fileBuf.resize(FILE_BUFFER_SIZE);
+        setvbuf(m_file, m_fileBuf.data(), _IOFBF, m_fileBuf.size());
+    }
+
+    m_dataBytes = 0;
+    if (m_container == WAV && WriteHeader(false) < 0)
+        return -1;
+
+    if (m_bufferSeconds > 0.0) {
+        m_ring.reset(new RingBuffer(std::max((size_t)(m_bufferSeconds * m_rate) * FrameBytes(),
+                                             2 * WRITER_BATCH_SIZE)));
+        m_drainBuf.resize(WRITER_BATCH_SIZE / FrameBytes() * FrameBytes());
+        m_stopping = false;
+        m_writer = std::thread(&FileSink::WriterLoop, this);
+    }
+    return 0;
+}
+
+int FileSink::Write(const void *pcm, size_t bytes)
+{
+    trace::Span span("FileSink::Write");
+    if (m_error)
+        return -1;
+    if (m_encoder) {
+        if (m_encoder->Encode(pcm, bytes / FrameBytes()) < 0) {
+            m_error = EIO;
+            return -1;
+        }
+        return 0;
+    }
+
+    errno = 0;
+    size_t written = fwrite(pcm, 1, bytes, m_file);
+    m_dataBytes += written;
+    if (written != bytes) {
+        // Disk full, or EPIPE on stdout, nothing after it is written
+        m_error = errno ? errno : EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Writes out everything queued in m_ring
+void FileSink::Drain()
+{
+    if (m_encoder) {
+        // Encoders take whole frames, which may wrap around the ring's end
+        size_t bytes;
+        while ((bytes = std::min(m_ring->Readable(), m_drainBuf.size())) > 0) {
+            m_ring->Read(m_drainBuf.data(), bytes);
+            if (Write(m_drainBuf.data(), bytes) < 0)
+                return;
+        }
+        return;
+    }
+
+    while (1) {
+        size_t bytes;
+        const char *data = m_ring->Peek(&bytes);
+        if (bytes == 0)
+            break;
+        if (Write(data, bytes) < 0)
+            return;
+        m_ring->Release(bytes);
+    }
+}
+
+void FileSink::Sync()
+{
+    fflush(m_file);
+    fsync(fileno(m_file));
+}
+
+void FileSink::WriterLoop()
+{
+    trace::NameThread("FileSink writer");
+    auto lastWrite = std::chrono::steady_clock::now();
+    auto lastSync = lastWrite;
+    while (1) {
+        const bool stopping = m_stopping.load();
+        const auto now = std::chrono::steady_clock::now();
+        const size_t queued = m_ring->Readable();
+        if (queued >= WRITER_BATCH_SIZE || stopping || (queued > 0 && now - lastWrite >= WRITER_MAX_DELAY)) {
+            Drain();
+            lastWrite = now;
+        }
+        if (stopping || m_error)
+            break;
+        if (m_file && m_fsync > 0 && now - lastSync >= std::chrono::seconds(m_fsync)) {
+            Sync();
+            lastSync = now;
+        }
+        std::this_thread::sleep_for(WRITER_POLL_PERIOD);
+    }
+}
+
+// Writes the header at the current position. Until the sizes are known,
+// they are written as 0xFFFFFFFF so that streaming readers treat the data as open-ended.
+int FileSink::WriteHeader(bool sized)
+{
+    const bool open = !sized;
+    const uint64_t riffBytes = WAV_HEADER_SIZE - 8 + m_dataBytes + (m_dataBytes & 1);
+    const bool rf64 = (riffBytes > 0xFFFFFFFFu);
+    const unsigned int blockAlign = m_chNum * m_bitsPerSample / 8;
+
+    uint8_t h[WAV_HEADER_SIZE];
+    memset(h, 0, sizeof(h));
+    uint8_t *p = h;
+    Put32(p, rf64 ? ID_RF64 : ID_RIFF);
+    Put32(p + 4, (open || rf64) ? 0xFFFFFFFFu : (uint32_t)riffBytes);
+    Put32(p + 8, ID_WAVE);
+    p += 12;
+
+    Put32(p, rf64 ? ID_DS64 : ID_JUNK);
+    Put32(p + 4, 28);
+    if (rf64) {
+        Put64(p + 8, riffBytes);
+        Put64(p + 16, m_dataBytes);
+        Put64(p + 24, m_dataBytes / blockAlign);
+        Put32(p + 32, 0); // no table entries
+    }
+    p += 8 + 28;
+
+    Put32(p, ID_FMT);
+    Put32(p + 4, 16);
+    Put16(p + 8, FORMAT_PCM);
+    Put16(p + 10, m_chNum);
+    Put32(p + 12, m_rate);
+    Put32(p + 16, m_rate * blockAlign);
+    Put16(p + 20, blockAlign);
+    Put16(p + 22, m_bitsPerSample);
+    p += 8 + 16;
+
+    Put32(p, ID_DATA);
+    Put32(p + 4, (open || rf64) ? 0xFFFFFFFFu : (uint32_t)m_dataBytes);
+
+    return fwrite(h, 1, sizeof(h), m_file) == sizeof(h) ? 0 : -1;
+}
+
+int FileSink::Close()
+{
+    if (m_writer.joinable()) {
+        m_stopping = true;
+        m_writer.join();
+    }
+
+    if (m_encoder) {
+        if (m_encoder->Finish() < 0 && !m_error)
+            m_error = EIO;
+    }
+
+    if (!m_file)
+        return m_error ? -1 : 0;
+
+    // What stdio still buffers may fail to be written too
+    if (fflush(m_file) != 0 && !m_error)
+        m_error = errno ? errno : EIO;
+
+    if (m_container == WAV && m_file != stdout && !m_error) {
+        // RIFF chunks are word aligned
+        if (m_dataBytes & 1)
+            fputc(0, m_file);
+        // Patch the sizes now that they are known, a file cut short keeps
+        // the open-ended ones
+        if (fseek(m_file, 0, SEEK_SET) != 0 || WriteHeader(true) < 0)
+            m_error = errno ? errno : EIO;
+    }
+
+    if (m_file != stdout) {
+        if (m_fsync != FSYNC_NONE)
+            Sync();
+        if (fclose(m_file) != 0 && !m_error)
+            m_error = errno ? errno : EIO;
+    }
+    m_file = nullptr;
+    return m_error ? -1 : 0;
+}
+
+int FileSink::Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp)
+{
+    (void)blocking;
+    (void)timestamp;
+    realtime::EnterAudioThread();
+    allocguard::EnterAudioThread();
+    trace::Span span("FileSink::Consume");
+
+    if (m_error)
+        return -1;
+
+    // Requantized for integer containers only, Opus codes the float as it is
+    const size_t bytes = samples * FrameBytes();
+    const char *frames = (const char *)data;
+    if (!m_float) {
+        if (m_pcm.size() < bytes)
+            m_pcm.resize(bytes);
+        m_requantizer.Process((const float *)data, samples, m_pcm.data());
+        frames = m_pcm.data();
+    }
+
+    if (m_ring) {
+        while (!m_ring->Write(frames, bytes)) {
+            if (m_error)
+                return -1;
+            if (m_dropWhenFull) {
+                m_dropped += samples;
+                return samples;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        m_ringPeak = std::max(m_ringPeak, m_ring->Readable());
+        return samples;
+    }
+
+    return Write(frames, bytes) < 0 ? -1 : (int)samples;
+}
@@ -0,0 +1,138 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * The sink that RouteA's stream-out blocks write the audio files through.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_FILESINK_H
+#define KPLAY_FILESINK_H
+
+#include <lark/lark.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Encoder.h"
+#include "Requantizer.h"
+#include "RingBuffer.h"
+
+// Takes float frames and writes them as integer PCM to a file or stdout,
+// either raw, in a RIFF/WAVE container, or compressed by an Encoder, which
+// may take the float frames as they are
+class FileSink : public lark::DataConsumer {
+public:
+    enum Container { RAW, WAV, FLAC, OPUS };
+
+    FileSink(unsigned int chNum, unsigned int bitsPerSample, unsigned int rate,
+             Requantizer::Dither dither, Container container);
+    virtual ~FileSink();
+
+    // FSYNC_NONE, FSYNC_ON_CLOSE, or else a period in seconds
+    enum { FSYNC_NONE = -1, FSYNC_ON_CLOSE = 0 };
+
+    // Decouples the writes and encoding from the route thread. Consume() then
+    // only queues the frames for a writer thread, which writes them out in
+    // large batches. If the writer falls behind, frames are dropped rather than
+    // waited for when dropWhenFull is set. Must be called before Open().
+    void SetAsync(double bufferSeconds, bool dropWhenFull);
+    void SetFsync(int policy)
+    {
+        m_fsync = policy;
+    }
+
+    // "--" opens stdout. Close() returns -1 if anything failed to be written,
+    // with Error() telling why.
+    int Open(const char *fileName);
+    int Close();
+
+    // The errno of the first failed write, 0 if none. Writing stops there.
+    int Error() const
+    {
+        return m_error;
+    }
+
+    uint64_t DroppedFrames() const
+    {
+        return m_dropped;
+    }
+
+    // The highest fill level the writer's ring ever reached, in percent
+    unsigned int RingPeakPercent() const
+    {
+        return m_ring ? (unsigned int)(m_ringPeak * 100 / m_ring->Capacity()) : 0;
+    }
+
+    // Returns false if the container isn't compressed
+    bool EncoderStats(uint64_t *frames, double *seconds) const
+    {
+        if (!m_encoder)
+            return false;
+        *frames = m_encoder->Frames();
+        *seconds = m_encoder->Seconds();
+        return true;
+    }
+
+    static int ParseContainer(const char *str, Container *container);
+    static bool IsCompressed(Container container)
+    {
+        return container == FLAC || container == OPUS;
+    }
+    static int ParseFsync(const char *str, int *policy);
+
+private:
+    virtual int Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp) override;
+
+    // Of what's queued and written, float frames if m_float
+    size_t FrameBytes() const
+    {
+        return m_float ? m_chNum * sizeof(float) : m_requantizer.FrameBytes();
+    }
+
+    int WriteHeader(bool sized);
+    void WriterLoop();
+    void Drain();
+    int Write(const void *pcm, size_t bytes);
+    void Sync();
+
+    FILE *m_file = nullptr;
+    std::unique_ptr<Encoder> m_encoder;
+    std::vector<char> m_fileBuf;
+    const unsigned int m_chNum;
+    const unsigned int m_bitsPerSample;
+    const unsigned int m_rate;
+    const Container m_container;
+    uint64_t m_dataBytes = 0;
+    int m_fsync = FSYNC_NONE;
+
+    double m_bufferSeconds = 0.0;
+    bool m_dropWhenFull = false;
+    std::vector<char> m_drainBuf;
+    std::unique_ptr<RingBuffer> m_ring;
+    std::thread m_writer;
+    std::atomic<bool> m_stopping { false };
+    uint64_t m_dropped = 0;
+    size_t m_ringPeak = 0;
+    std::atomic<int> m_error { 0 };
+
+    Requantizer m_requantizer;
+    std::vector<char> m_pcm;
+    bool m_float = false;
+};
+
+#endif
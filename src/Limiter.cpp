@@ -0,0 +1,160 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Lookahead true-peak limiter.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Limiter.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+Limiter::Limiter(Stage *upstream, unsigned int chNum, unsigned int rate, double ceilingDb)
+    : Stage(upstream), m_chNum(chNum), m_ceiling((float)std::pow(10.0, ceilingDb / 20.0)),
+      m_lookahead(std::max(5/*ms*/ * rate / 1000, 1u)),
+      m_release(1.0 - std::exp(-1.0 / (0.05/*s*/ * rate))),
+      m_history(chNum * 2 * TAPS), m_delay((m_lookahead + DETECT_DELAY) * chNum),
+      m_minValue(m_lookahead + 2), m_minIndex(m_lookahead + 2), m_avg(m_lookahead)
+{
+    // Blackman windowed sinc for the points at 1/4, 2/4 and 3/4 past the
+    // middle of the history, oldest sample first
+    for (unsigned int p = 1; p < PHASES; ++p) {
+        float *h = m_coefs[p - 1];
+        double sum = 0.0;
+        for (unsigned int k = 0; k < TAPS; ++k) {
+            const double x = (double)TAPS / 2 - 1 - k + (double)p / PHASES;
+            const double sinc = M_PI * x;
+            const double win = 0.42 + 0.5 * std::cos(M_PI * x / (TAPS / 2)) + 0.08 * std::cos(2.0 * M_PI * x / (TAPS / 2));
+            h[k] = (float)(std::sin(sinc) / sinc * win);
+            sum += h[k];
+        }
+        for (unsigned int k = 0; k < TAPS; ++k)
+            h[k] = (float)(h[k] / sum);
+    }
+
+    Reset();
+}
+
+void Limiter::Reset()
+{
+    Stage::Reset();
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    m_historyPos = 0;
+    std::fill(m_delay.begin(), m_delay.end(), 0.0f);
+    m_delayPos = 0;
+    m_minHead = 0;
+    m_minCount = 0;
+    std::fill(m_avg.begin(), m_avg.end(), 1.0f);
+    m_avgPos = 0;
+    m_avgSum = m_lookahead;
+    m_index = 0;
+    m_gain = 1.0f;
+    m_flush = 0;
+    m_eof = false;
+}
+
+inline void Limiter::ProcessFrame(float *frame)
+{
+    // True peak of the interval starting DETECT_DELAY frames back
+    m_historyPos = (m_historyPos + 1) % TAPS;
+    float peak = 0.0f;
+    for (unsigned int c = 0; c < m_chNum; ++c) {
+        float *h = &m_history[c * 2 * TAPS];
+        h[m_historyPos] = h[m_historyPos + TAPS] = frame[c];
+        const float *x = h + m_historyPos + 1;
+        peak = std::max(peak, std::fabs(x[TAPS / 2 - 1]));
+        for (unsigned int p = 0; p < PHASES - 1; ++p)
+            peak = std::max(peak, std::fabs(simd::Dot(x, m_coefs[p], TAPS)));
+    }
+
+    const float required = peak > m_ceiling ? m_ceiling / peak : 1.0f;
+
+    // Minimum over the last m_lookahead + 1 frames, so that every gain
+    // averaged below has already seen the peak m_lookahead frames ahead
+    const unsigned int cap = (unsigned int)m_minValue.size();
+    while (m_minCount && m_minValue[(m_minHead + m_minCount - 1) % cap] >= required)
+        --m_minCount;
+    const unsigned int tail = (m_minHead + m_minCount) % cap;
+    m_minValue[tail] = required;
+    m_minIndex[tail] = m_index;
+    ++m_minCount;
+    while (m_minIndex[m_minHead] + m_lookahead + 1 <= m_index) {
+        m_minHead = (m_minHead + 1) % cap;
+        --m_minCount;
+    }
+    const float held = m_minValue[m_minHead];
+    ++m_index;
+
+    // Smooth the attack over the lookahead, release exponentially
+    m_avgSum += held - m_avg[m_avgPos];
+    m_avg[m_avgPos] = held;
+    m_avgPos = (m_avgPos + 1) % m_lookahead;
+    const float target = std::min((float)(m_avgSum / m_lookahead), 1.0f);
+    if (target < m_gain)
+        m_gain = target;
+    else if (target - m_gain > 1e-5f)
+        m_gain += (target - m_gain) * (float)m_release;
+    else
+        m_gain = target;
+
+    float *delayed = &m_delay[m_delayPos * m_chNum];
+    for (unsigned int c = 0; c < m_chNum; ++c) {
+        const float in = frame[c];
+        frame[c] = delayed[c] * m_gain;
+        delayed[c] = in;
+    }
+    m_delayPos = (m_delayPos + 1) % (m_lookahead + DETECT_DELAY);
+}
+
+int Limiter::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("Limiter");
+    int ret = m_eof ? lark::E_EOF : m_upstream->Pull(out, frames);
+    if (ret <= 0) {
+        // Push the delay line out with silence
+        if (!m_eof) {
+            m_eof = true;
+            m_flush = m_lookahead + DETECT_DELAY;
+        }
+        if (m_flush == 0)
+            return lark::E_EOF;
+        ret = (int)std::min<unsigned int>(frames, m_flush);
+        m_flush -= ret;
+        memset(out, 0, (size_t)ret * m_chNum * sizeof(float));
+    }
+
+    float minGain = 1.0f;
+    uint64_t limited = 0;
+    for (int i = 0; i < ret; ++i) {
+        ProcessFrame(out + (size_t)i * m_chNum);
+        if (m_gain < 1.0f) {
+            minGain = std::min(minGain, m_gain);
+            ++limited;
+        }
+    }
+
+    const float grDb = 20.0f * std::log10(minGain);
+    m_grDb.store(grDb, std::memory_order_relaxed);
+    if (grDb < m_grMaxDb.load(std::memory_order_relaxed))
+        m_grMaxDb.store(grDb, std::memory_order_relaxed);
+    if (limited)
+        m_limitedFrames.fetch_add(limited, std::memory_order_relaxed);
+    return ret;
+}
@@ -0,0 +1,95 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Lookahead true-peak limiter.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_LIMITER_H
+#define KPLAY_LIMITER_H
+
+#include "Pipeline.h"
+#include <atomic>
+#include <vector>
+
+// Keeps the true peak (4x oversampled, as in BS.1770 Annex 2) under a ceiling.
+// The gain is linked across channels, reaches its target within the lookahead
+// before a peak arrives and recovers with an exponential release.
+class Limiter : public Stage {
+public:
+    Limiter(Stage *upstream, unsigned int chNum, unsigned int rate, double ceilingDb);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    // Gain reduction metrics in dB (<= 0), safe to read from any thread
+    float GainReductionDb() const
+    {
+        return m_grDb.load(std::memory_order_relaxed);
+    }
+    float MaxGainReductionDb() const
+    {
+        return m_grMaxDb.load(std::memory_order_relaxed);
+    }
+    uint64_t LimitedFrames() const
+    {
+        return m_limitedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    enum {
+        TAPS = 24,          // per interpolation phase, a multiple of 8 for simd::Dot
+        PHASES = 4,
+        DETECT_DELAY = TAPS / 2
+    };
+
+    void ProcessFrame(float *frame);
+
+    const unsigned int m_chNum;
+    const float m_ceiling;
+    const unsigned int m_lookahead;     // frames
+    const double m_release;             // per-frame recovery coefficient
+
+    float m_coefs[PHASES - 1][TAPS];
+    ArenaVector<float> m_history;       // 2 * TAPS per channel, written twice for a contiguous window
+    unsigned int m_historyPos = 0;
+
+    ArenaVector<float> m_delay;         // (m_lookahead + DETECT_DELAY) frames
+    unsigned int m_delayPos = 0;
+
+    // Sliding minimum of the required gain over m_lookahead + 1 frames
+    ArenaVector<float> m_minValue;
+    ArenaVector<uint64_t> m_minIndex;
+    unsigned int m_minHead = 0;
+    unsigned int m_minCount = 0;
+
+    // Moving average of the sliding minimum over m_lookahead frames
+    ArenaVector<float> m_avg;
+    unsigned int m_avgPos = 0;
+    double m_avgSum = 0.0;
+
+    uint64_t m_index = 0;
+    float m_gain = 1.0f;
+    unsigned int m_flush = 0;           // frames of silence left to push the delay out at EOF
+    bool m_eof = false;
+
+    std::atomic<float> m_grDb { 0.0f };
+    std::atomic<float> m_grMaxDb { 0.0f };
+    std::atomic<uint64_t> m_limitedFrames { 0 };
+};
+
+#endif
@@ -0,0 +1,194 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * EBU R128 integrated loudness measurement.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Loudness.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+// Histogram bins of 0.1 LU from the absolute gate at -70 LUFS up to +10,
+// louder blocks land in the last one
+static const double BIN_LU = 0.1;
+static const size_t BINS = 800;
+
+LoudnessMeter::LoudnessMeter(unsigned int chNum, unsigned int rate, bool bounded)
+    : m_chNum(chNum), m_stepFrames(rate / 10), m_bounded(bounded)
+{
+    // The BS.1770 pre-filter and RLB weighting, derived for any sample rate
+    double f0 = 1681.974450955533;
+    const double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = std::tan(M_PI * f0 / rate);
+    const double Vh = std::pow(10.0, G / 20.0);
+    const double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    m_shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    m_shelf.b1 = 2.0 * (K * K - Vh) / a0;
+    m_shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    m_shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+    m_shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = std::tan(M_PI * f0 / rate);
+    a0 = 1.0 + K / Q + K * K;
+    m_highPass.b0 = 1.0;
+    m_highPass.b1 = -2.0;
+    m_highPass.b2 = 1.0;
+    m_highPass.a1 = 2.0 * (K * K - 1.0) / a0;
+    m_highPass.a2 = (1.0 - K / Q + K * K) / a0;
+
+    Reset();
+}
+
+void LoudnessMeter::Reset()
+{
+    m_state.assign(m_chNum * 4, 0.0);
+    m_stepSum.assign(m_chNum, 0.0);
+    m_stepFill = 0;
+    m_stepCount = 0;
+    m_blocks.clear();
+    if (m_bounded) {
+        m_binCount.assign(BINS, 0);
+        m_binSum.assign(BINS, 0.0);
+    }
+}
+
+void LoudnessMeter::Add(const float *in, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        for (unsigned int c = 0; c < m_chNum; ++c) {
+            // Transposed direct form II, twice
+            double *s = &m_state[c * 4];
+            double x = in[i * m_chNum + c];
+            double y = m_shelf.b0 * x + s[0];
+            s[0] = m_shelf.b1 * x - m_shelf.a1 * y + s[1];
+            s[1] = m_shelf.b2 * x - m_shelf.a2 * y;
+            x = y;
+            y = m_highPass.b0 * x + s[2];
+            s[2] = m_highPass.b1 * x - m_highPass.a1 * y + s[3];
+            s[3] = m_highPass.b2 * x - m_highPass.a2 * y;
+            m_stepSum[c] += y * y;
+        }
+
+        if (++m_stepFill < m_stepFrames)
+            continue;
+
+        // Both channels of mono and stereo are weighted 1.0
+        double ms = 0.0;
+        for (unsigned int c = 0; c < m_chNum; ++c) {
+            ms += m_stepSum[c] / m_stepFrames;
+            m_stepSum[c] = 0.0;
+        }
+        m_stepFill = 0;
+        m_steps[m_stepCount % 4] = ms;
+        if (++m_stepCount >= 4)
+            AddBlock((m_steps[0] + m_steps[1] + m_steps[2] + m_steps[3]) / 4.0);
+    }
+}
+
+static inline double ToLufs(double meanSquare)
+{
+    return -0.691 + 10.0 * std::log10(meanSquare);
+}
+
+void LoudnessMeter::AddBlock(double meanSquare)
+{
+    if (!m_bounded) {
+        m_blocks.push_back(meanSquare);
+        return;
+    }
+
+    // Under the absolute gate, never counted
+    const double bin = (ToLufs(meanSquare) + 70.0) / BIN_LU;
+    if (!(bin >= 0.0))
+        return;
+    const size_t i = std::min((size_t)bin, BINS - 1);
+    ++m_binCount[i];
+    m_binSum[i] += meanSquare;
+}
+
+double LoudnessMeter::Integrated() const
+{
+    if (!m_bounded) {
+        const double absGate = std::pow(10.0, (-70.0 + 0.691) / 10.0);
+        double sum = 0.0;
+        size_t n = 0;
+        for (double b : m_blocks) {
+            if (b > absGate) {
+                sum += b;
+                ++n;
+            }
+        }
+        if (n == 0)
+            return -HUGE_VAL;
+
+        const double relGate = sum / n * std::pow(10.0, -10.0 / 10.0);
+        sum = 0.0;
+        n = 0;
+        for (double b : m_blocks) {
+            if (b > absGate && b > relGate) {
+                sum += b;
+                ++n;
+            }
+        }
+        return n ? ToLufs(sum / n) : -HUGE_VAL;
+    }
+
+    double sum = 0.0;
+    size_t n = 0;
+    for (size_t i = 0; i < BINS; ++i) {
+        sum += m_binSum[i];
+        n += m_binCount[i];
+    }
+    if (n == 0)
+        return -HUGE_VAL;
+
+    // A bin is in or out of the relative gate as a whole, by its mean
+    const double relGate = sum / n * std::pow(10.0, -10.0 / 10.0);
+    sum = 0.0;
+    n = 0;
+    for (size_t i = 0; i < BINS; ++i) {
+        if (m_binCount[i] && m_binSum[i] / m_binCount[i] > relGate) {
+            sum += m_binSum[i];
+            n += m_binCount[i];
+        }
+    }
+    return n ? ToLufs(sum / n) : -HUGE_VAL;
+}
+
+int LoudnessStage::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("Loudness");
+    int ret = m_upstream->Pull(out, frames);
+    if (ret > 0)
+        m_meter.Add(out, ret);
+    else
+        m_complete = true;
+    return ret;
+}
+
+void LoudnessStage::Reset()
+{
+    Stage::Reset();
+    m_meter.Reset();
+    m_complete = false;
+}
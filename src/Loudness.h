@@ -0,0 +1,93 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * EBU R128 integrated loudness measurement.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_LOUDNESS_H
+#define KPLAY_LOUDNESS_H
+
+#include "Pipeline.h"
+#include <vector>
+
+// Integrated loudness per ITU-R BS.1770 / EBU R128: K-weighted,
+// 400 ms blocks every 100 ms, absolute gate at -70 LUFS, relative gate at -10 LU
+class LoudnessMeter {
+public:
+    // Every block is kept and gated exactly, unless bounded. Bounded meters
+    // keep them in a histogram of 0.1 LU bins instead, so that measuring any
+    // length of audio never allocates, gating exactly but for the bin the
+    // relative gate falls in.
+    LoudnessMeter(unsigned int chNum, unsigned int rate, bool bounded = false);
+
+    void Add(const float *in, size_t frames);
+    void Reset();
+
+    // Returns the integrated loudness in LUFS, or -HUGE_VAL if everything was gated
+    double Integrated() const;
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+
+    void AddBlock(double meanSquare);
+
+    const unsigned int m_chNum;
+    Biquad m_shelf;
+    Biquad m_highPass;
+    ArenaVector<double> m_state;    // 4 per channel, 2 for each filter
+
+    const size_t m_stepFrames;      // 100 ms
+    size_t m_stepFill = 0;
+    ArenaVector<double> m_stepSum;  // per channel, of the current step
+    double m_steps[4];              // mean square of the last 4 steps
+    unsigned int m_stepCount = 0;
+    const bool m_bounded;
+    std::vector<double> m_blocks;   // mean square of every 400 ms block
+    ArenaVector<size_t> m_binCount; // or, bounded, blocks per bin from -70 LUFS up
+    ArenaVector<double> m_binSum;   // and the sum of their mean squares
+};
+
+// Measures the frames passing through it, on the route thread, so bounded
+class LoudnessStage : public Stage {
+public:
+    LoudnessStage(Stage *upstream, unsigned int chNum, unsigned int rate)
+        : Stage(upstream), m_chNum(chNum), m_meter(chNum, rate, true) { }
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    // True once the whole input has been measured
+    bool Complete() const
+    {
+        return m_complete;
+    }
+
+    const LoudnessMeter &Meter() const
+    {
+        return m_meter;
+    }
+
+private:
+    const unsigned int m_chNum;
+    LoudnessMeter m_meter;
+    bool m_complete = false;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-channel peak and RMS level meters.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Meter.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+MeterStage::MeterStage(Stage *upstream, unsigned int chNum, unsigned int rate)
+    : Stage(upstream), m_chNum(chNum), m_windowFrames(rate / 20),
+      m_accPeak(new float[std::max(chNum, 4u)]), m_accSumSq(new float[std::max(chNum, 4u)]),
+      m_peak(new std::atomic<float>[chNum]), m_rms(new std::atomic<float>[chNum])
+{
+    Reset();
+}
+
+void MeterStage::Reset()
+{
+    Stage::Reset();
+    std::fill(m_accPeak.get(), m_accPeak.get() + std::max(m_chNum, 4u), 0.0f);
+    std::fill(m_accSumSq.get(), m_accSumSq.get() + std::max(m_chNum, 4u), 0.0f);
+    m_frames = 0;
+    for (unsigned int c = 0; c < m_chNum; ++c) {
+        m_peak[c].store(0.0f, std::memory_order_relaxed);
+        m_rms[c].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+void MeterStage::Publish()
+{
+    if (4 % m_chNum == 0) {
+        // Fold the lanes back into channels
+        for (unsigned int l = m_chNum; l < 4; ++l) {
+            m_accPeak[l % m_chNum] = std::max(m_accPeak[l % m_chNum], m_accPeak[l]);
+            m_accSumSq[l % m_chNum] += m_accSumSq[l];
+        }
+    }
+    for (unsigned int c = 0; c < m_chNum; ++c) {
+        m_peak[c].store(m_accPeak[c], std::memory_order_relaxed);
+        m_rms[c].store(std::sqrt(m_accSumSq[c] / m_frames), std::memory_order_relaxed);
+    }
+    std::fill(m_accPeak.get(), m_accPeak.get() + std::max(m_chNum, 4u), 0.0f);
+    std::fill(m_accSumSq.get(), m_accSumSq.get() + std::max(m_chNum, 4u), 0.0f);
+    m_frames = 0;
+}
+
+int MeterStage::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("Meter");
+    int ret = m_upstream->Pull(out, frames);
+    if (ret <= 0)
+        return ret;
+
+    const size_t n = (size_t)ret * m_chNum;
+    if (4 % m_chNum == 0) {
+        // Sample i lands in lane i % 4, which always carries channel i % m_chNum
+        simd::PeakSumSq(out, n, m_accPeak.get(), m_accSumSq.get());
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            const unsigned int c = i % m_chNum;
+            m_accPeak[c] = std::max(m_accPeak[c], std::fabs(out[i]));
+            m_accSumSq[c] += out[i] * out[i];
+        }
+    }
+
+    m_frames += ret;
+    if (m_frames >= m_windowFrames)
+        Publish();
+    return ret;
+}
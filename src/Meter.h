@@ -0,0 +1,60 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-channel peak and RMS level meters.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_METER_H
+#define KPLAY_METER_H
+
+#include "Pipeline.h"
+#include <atomic>
+#include <memory>
+
+// Measures the frames passing through it and publishes the peak and RMS
+// of every channel once per window, for the display to pick up from any thread
+class MeterStage : public Stage {
+public:
+    MeterStage(Stage *upstream, unsigned int chNum, unsigned int rate);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    // Linear levels of the last complete window
+    float Peak(unsigned int ch) const
+    {
+        return m_peak[ch].load(std::memory_order_relaxed);
+    }
+    float Rms(unsigned int ch) const
+    {
+        return m_rms[ch].load(std::memory_order_relaxed);
+    }
+
+private:
+    void Publish();
+
+    const unsigned int m_chNum;
+    const size_t m_windowFrames;    // 50 ms
+    size_t m_frames = 0;
+    std::unique_ptr<float[]> m_accPeak;
+    std::unique_ptr<float[]> m_accSumSq;
+    std::unique_ptr<std::atomic<float>[]> m_peak;
+    std::unique_ptr<std::atomic<float>[]> m_rms;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Min/max peak pyramid of a whole file, for drawing its waveform.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Overview.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char MAGIC[8] = { 'K', 'P', 'O', 'V', 'W', '0', '0', '2' };
+
+static const double FLOOR_DB = -96.0;
+static const double STEP_DB = 96.0 / 126;
+
+// Quietest to loudest, 6 dB apart from -48 dBFS
+static const char RAMP[] = " .:-=+*#%@";
+
+int8_t Overview::Encode(float v)
+{
+    const double mag = std::fabs(v);
+    if (mag <= 0.0)
+        return 0;
+    const double steps = std::ceil((20.0 * std::log10(mag) - FLOOR_DB) / STEP_DB);
+    const int code = steps < 0.0 ? 0 : (int)std::min(steps + 1.0, 127.0);
+    return (int8_t)(v < 0.0f ? -code : code);
+}
+
+double Overview::Decibels(int8_t code)
+{
+    return code == 0 ? -HUGE_VAL : FLOOR_DB + (std::abs((int)code) - 1) * STEP_DB;
+}
+
+void Overview::Add(const float *in, size_t frames, unsigned int chNum)
+{
+    if (m_levels.empty())
+        m_levels.resize(1);
+    while (frames > 0) {
+        const size_t n = std::min<size_t>(frames, BIN_FRAMES - m_fill);
+        if (m_fill == 0) {
+            m_min = in[0];
+            m_max = in[0];
+        }
+        simd::MinMax(in, n * chNum, &m_min, &m_max);
+        m_fill += n;
+        m_frames += n;
+        in += n * chNum;
+        frames -= n;
+        if (m_fill == BIN_FRAMES)
+            Push();
+    }
+}
+
+void Overview::Push()
+{
+    Bin bin;
+    // A bin whose samples all have one sign still spans 0
+    bin.min = m_min < 0.0f ? Encode(m_min) : 0;
+    bin.max = m_max > 0.0f ? Encode(m_max) : 0;
+    m_levels[0].push_back(bin);
+    m_fill = 0;
+}
+
+void Overview::Finish()
+{
+    if (m_levels.empty())
+        return;
+    if (m_fill > 0)
+        Push();
+    m_levels.resize(1);
+    while (m_levels.back().size() > 1) {
+        const std::vector<Bin> &below = m_levels.back();
+        std::vector<Bin> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); ++i) {
+            const Bin &a = below[2 * i];
+            const Bin &b = 2 * i + 1 < below.size() ? below[2 * i + 1] : a;
+            level[i].min = std::min(a.min, b.min);
+            level[i].max = std::max(a.max, b.max);
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+void Overview::Clear()
+{
+    m_levels.clear();
+    m_frames = 0;
+    m_fill = 0;
+}
+
+int Overview::Load(const std::string &path)
+{
+    Clear();
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return -1;
+    char magic[sizeof(MAGIC)];
+    uint64_t frames;
+    uint32_t binFrames;
+    int ret = -1;
+    if (fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 &&
+        fread(&binFrames, sizeof(binFrames), 1, fp) == 1 && binFrames == BIN_FRAMES &&
+        fread(&frames, sizeof(frames), 1, fp) == 1 && frames > 0 && frames < ((uint64_t)1 << 40)) {
+        m_levels.resize(1);
+        m_levels[0].resize((size_t)((frames + BIN_FRAMES - 1) / BIN_FRAMES));
+        if (fread(m_levels[0].data(), sizeof(Bin), m_levels[0].size(), fp) == m_levels[0].size() &&
+            fgetc(fp) == EOF) {
+            m_frames = frames;
+            Finish();
+            ret = 0;
+        }
+    }
+    fclose(fp);
+    if (ret < 0)
+        Clear();
+    return ret;
+}
+
+int Overview::Save(const std::string &path) const
+{
+    if (Empty())
+        return -1;
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return -1;
+    const uint32_t binFrames = BIN_FRAMES;
+    const bool ok = fwrite(MAGIC, sizeof(MAGIC), 1, fp) == 1 &&
+        fwrite(&binFrames, sizeof(binFrames), 1, fp) == 1 &&
+        fwrite(&m_frames, sizeof(m_frames), 1, fp) == 1 &&
+        fwrite(m_levels[0].data(), sizeof(Bin), m_levels[0].size(), fp) == m_levels[0].size();
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+void Overview::Render(char *out, unsigned int width, double position) const
+{
+    memset(out, ' ', width);
+    out[width] = '\0';
+    if (Empty() || width == 0)
+        return;
+
+    // The coarsest level that still has a bin for every column
+    size_t level = 0;
+    while (level + 1 < m_levels.size() && m_levels[level + 1].size() >= width)
+        ++level;
+    const std::vector<Bin> &bins = m_levels[level];
+
+    const size_t n = bins.size();
+    for (unsigned int c = 0; c < width; ++c) {
+        const size_t from = c * n / width;
+        const size_t to = std::max(from + 1, (size_t)(c + 1) * n / width);
+        int peak = 0;
+        for (size_t i = from; i < to && i < n; ++i)
+            peak = std::max(peak, std::max(-(int)bins[i].min, (int)bins[i].max));
+        const double db = Decibels((int8_t)peak);
+        const int step = db < -48.0 ? 0 : std::min((int)sizeof(RAMP) - 2, 1 + (int)((db + 48.0) / 6.0));
+        out[c] = RAMP[step];
+    }
+    if (position >= 0.0 && position <= 1.0)
+        out[std::min(width - 1, (unsigned int)(position * width))] = '|';
+}
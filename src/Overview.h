@@ -0,0 +1,92 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Min/max peak pyramid of a whole file, for drawing its waveform.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_OVERVIEW_H
+#define KPLAY_OVERVIEW_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every channel's samples are folded into one min and max per bin of
+// BIN_FRAMES frames, kept as 8 bits each on a decibel scale fine enough to
+// tell silence from quiet, rounded outwards. Each level above
+// the first halves the bins of the one below. Only the first level is
+// saved, the others take no time to fold again when loaded.
+class Overview {
+public:
+    static const unsigned int BIN_FRAMES = 4096;
+
+    struct Bin {
+        int8_t min;
+        int8_t max;
+    };
+
+    // Codes 1 to 127 are magnitudes from -96 to 0 dBFS in equal steps,
+    // signed as the sample is, 0 is anything quieter
+    static int8_t Encode(float v);
+    // Magnitude in dBFS, -HUGE_VAL for 0
+    static double Decibels(int8_t code);
+
+    // Accumulates interleaved frames, then Finish() folds the levels
+    void Add(const float *in, size_t frames, unsigned int chNum);
+    void Finish();
+    void Clear();
+
+    bool Empty() const
+    {
+        return m_levels.empty() || m_levels[0].empty();
+    }
+
+    uint64_t Frames() const
+    {
+        return m_frames;
+    }
+
+    const std::vector<Bin> &Level(size_t level) const
+    {
+        return m_levels[level];
+    }
+    size_t Levels() const
+    {
+        return m_levels.size();
+    }
+
+    // Returns -1 if path can't be read or isn't a whole overview
+    int Load(const std::string &path);
+    int Save(const std::string &path) const;
+
+    // Draws the whole file in width columns of ASCII, louder columns with
+    // denser characters, and a '|' at position (0 to 1). out gets width
+    // characters and a terminating 0, and nothing is allocated.
+    void Render(char *out, unsigned int width, double position) const;
+
+private:
+    void Push();
+
+    std::vector<std::vector<Bin>> m_levels;
+    uint64_t m_frames = 0;
+    size_t m_fill = 0;                      // frames in the bin being accumulated
+    float m_min = 0.0f;
+    float m_max = 0.0f;
+};
+
+#endif
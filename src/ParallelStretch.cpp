@@ -0,0 +1,220 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Offline time stretching of overlapping segments on several threads.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "ParallelStretch.h"
+#include "Fft.h"
+#include "Simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+int BufferSource::Pull(float *out, lark::samples_t frames)
+{
+    if (m_pos >= m_frames)
+        return lark::E_EOF;
+    const size_t n = std::min<size_t>(frames, m_frames - m_pos);
+    memcpy(out, m_data + m_pos * m_chNum, n * m_chNum * sizeof(float));
+    m_pos += n;
+    return (int)n;
+}
+
+// Returns the lag within [-range, range] around b that best continues cur at a
+static long BestLag(const std::vector<float> &cur, size_t a, const std::vector<float> &next, size_t b,
+    size_t fade, size_t range, unsigned int chNum)
+{
+    const size_t nextFrames = next.size() / chNum;
+    const size_t n = fade * chNum / 8 * 8;
+    long best = 0;
+    double bestScore = -HUGE_VAL;
+    for (long lag = -(long)range; lag <= (long)range; ++lag) {
+        if ((long)b + lag < 0 || b + lag + fade > nextFrames)
+            continue;
+        const float *x = &cur[a * chNum];
+        const float *y = &next[(b + lag) * chNum];
+        const double energy = simd::Dot(y, y, n);
+        const double score = energy > 0.0 ? simd::Dot(x, y, n) / std::sqrt(energy) : 0.0;
+        if (score > bestScore) {
+            bestScore = score;
+            best = lag;
+        }
+    }
+    return best;
+}
+
+int StretchInParallel(const std::vector<float> &in, unsigned int chNum, unsigned int rate, double tempo,
+    unsigned int jobs, const StretchEngine &engine, std::vector<float> *out, std::vector<size_t> *seams)
+{
+    const size_t total = in.size() / chNum;
+    const size_t pad = rate;
+    const size_t fade = rate / 20;
+    const size_t range = rate / 100;
+    jobs = std::max(jobs, 1u);
+
+    // A few segments per thread keep them all busy to the end
+    const size_t segment = std::max<size_t>(5 * rate, (total + jobs * 4 - 1) / (jobs * 4));
+    const size_t count = std::max<size_t>((total + segment - 1) / segment, 1);
+
+    struct Segment {
+        size_t inStart;
+        std::vector<float> out;
+        int ret;
+    };
+    std::vector<Segment> segs(count);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            Segment &seg = segs[i];
+            seg.inStart = i * segment > pad ? i * segment - pad : 0;
+            const size_t inEnd = std::min(total, (i + 1) * segment + pad);
+            BufferSource source(in.data() + seg.inStart * chNum, inEnd - seg.inStart, chNum);
+            seg.ret = engine(&source, &seg.out);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < std::min<size_t>(jobs, count); ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+    for (const auto &seg : segs) {
+        if (seg.ret < 0)
+            return seg.ret;
+    }
+
+    // Stitch the segments where one ends and the next begins in the input
+    out->clear();
+    if (seams)
+        seams->clear();
+    size_t from = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const std::vector<float> &cur = segs[i].out;
+        const size_t curFrames = cur.size() / chNum;
+        from = std::min(from, curFrames);
+        if (i + 1 == count) {
+            out->insert(out->end(), cur.begin() + from * chNum, cur.end());
+            break;
+        }
+
+        const std::vector<float> &nxt = segs[i + 1].out;
+        const size_t nxtFrames = nxt.size() / chNum;
+        const size_t a = (size_t)(((i + 1) * segment - segs[i].inStart) / tempo);
+        const size_t b = (size_t)(((i + 1) * segment - segs[i + 1].inStart) / tempo);
+        if (a + fade > curFrames || b + range + fade > nxtFrames) {
+            // Too short to align, keep all of this one and skip what the next repeats of it
+            out->insert(out->end(), cur.begin() + from * chNum, cur.end());
+            if (seams)
+                seams->push_back(out->size() / chNum);
+            const size_t inEnd = std::min(total, (i + 1) * segment + pad);
+            from = (size_t)((inEnd - segs[i + 1].inStart) / tempo);
+            continue;
+        }
+        const size_t start = b + BestLag(cur, a, nxt, b, fade, range, chNum);
+
+        if (from < a)
+            out->insert(out->end(), cur.begin() + from * chNum, cur.begin() + a * chNum);
+        if (seams)
+            seams->push_back(out->size() / chNum);
+        for (size_t j = 0; j < fade; ++j) {
+            const float w = (j + 0.5f) / fade;
+            for (unsigned int c = 0; c < chNum; ++c)
+                out->push_back(cur[(a + j) * chNum + c] * (1.0f - w) + nxt[(start + j) * chNum + c] * w);
+        }
+        from = start + fade;
+    }
+    return 0;
+}
+
+double SpectralDistance(const std::vector<float> &a, const std::vector<float> &b, unsigned int chNum)
+{
+    const unsigned int size = 2048;
+    const size_t frames = std::min(a.size(), b.size()) / chNum;
+    Fft fft(size);
+    std::vector<float> window(size), x(size), y(size);
+    std::vector<std::complex<float>> X(size / 2 + 1), Y(size / 2 + 1);
+    for (unsigned int i = 0; i < size; ++i)
+        window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / size));
+
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t start = 0; start + size <= frames; start += size / 2) {
+        for (unsigned int c = 0; c < chNum; ++c) {
+            double energy = 0.0;
+            for (unsigned int i = 0; i < size; ++i) {
+                x[i] = a[(start + i) * chNum + c] * window[i];
+                y[i] = b[(start + i) * chNum + c] * window[i];
+                energy += x[i] * x[i] + y[i] * y[i];
+            }
+            if (energy < 1e-6)
+                continue;   // silence says nothing about quality
+            fft.Forward(x.data(), X.data());
+            fft.Forward(y.data(), Y.data());
+
+            // Bins more than 60 dB under the frame's loudest don't count either
+            float peak = 0.0f;
+            for (unsigned int k = 0; k <= size / 2; ++k)
+                peak = std::max(peak, std::max(std::norm(X[k]), std::norm(Y[k])));
+            const float floor = peak * 1e-6f;
+            double d = 0.0;
+            for (unsigned int k = 0; k <= size / 2; ++k) {
+                const double db = 10.0 * std::log10((std::norm(X[k]) + floor) / (std::norm(Y[k]) + floor));
+                d += db * db;
+            }
+            sum += std::sqrt(d / (size / 2 + 1));
+            ++count;
+        }
+    }
+    return count ? sum / count : 0.0;
+}
+
+// The largest difference between consecutive frames of any channel in [begin, end)
+static float MaxStep(const std::vector<float> &x, size_t begin, size_t end, unsigned int chNum)
+{
+    float step = 0.0f;
+    for (size_t i = std::max<size_t>(begin, 1); i < end; ++i) {
+        for (unsigned int c = 0; c < chNum; ++c)
+            step = std::max(step, std::fabs(x[i * chNum + c] - x[(i - 1) * chNum + c]));
+    }
+    return step;
+}
+
+double SeamDiscontinuity(const std::vector<float> &out, const std::vector<size_t> &seams, unsigned int chNum,
+    unsigned int rate)
+{
+    const size_t frames = out.size() / chNum;
+    const size_t fade = rate / 20;
+    const size_t guard = rate / 200;
+    const size_t around = rate / 10;
+    double worst = -HUGE_VAL;
+    for (size_t seam : seams) {
+        const size_t begin = seam > guard ? seam - guard : 0;
+        const size_t end = std::min(frames, seam + fade + guard);
+        const float step = MaxStep(out, begin, end, chNum);
+        const float usual = std::max(MaxStep(out, begin > around ? begin - around : 0, begin, chNum),
+                                     MaxStep(out, end, std::min(frames, end + around), chNum));
+        if (step < 1e-5f)
+            continue;   // silent, nothing to hear
+        worst = std::max(worst, 20.0 * std::log10(step / std::max(usual, 1e-5f)));
+    }
+    return worst == -HUGE_VAL ? 0.0 : worst;
+}
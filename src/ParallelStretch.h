@@ -0,0 +1,72 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Offline time stretching of overlapping segments on several threads.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_PARALLELSTRETCH_H
+#define KPLAY_PARALLELSTRETCH_H
+
+#include "Pipeline.h"
+#include <functional>
+#include <vector>
+
+// Plays interleaved float frames held in memory
+class BufferSource : public Stage {
+public:
+    BufferSource(const float *data, size_t frames, unsigned int chNum)
+        : m_data(data), m_frames(frames), m_chNum(chNum) { }
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override
+    {
+        m_pos = 0;
+    }
+
+private:
+    const float *m_data;
+    const size_t m_frames;
+    const unsigned int m_chNum;
+    size_t m_pos = 0;
+};
+
+// Runs one engine instance over the whole source, appending its output to out.
+// Called from several threads at once, each call with a source of its own.
+typedef std::function<int(Stage *source, std::vector<float> *out)> StretchEngine;
+
+// Stretches in by 1 / tempo in segments of at least 5 s, each one padded with
+// 1 s of its neighbours, on jobs threads. Consecutive segments are aligned by
+// cross-correlation within 10 ms around where they should meet, then
+// crossfaded over 50 ms. Any delay the engine adds is the same for every
+// segment, so out lines up with what one engine instance makes of in.
+// Where each join starts in out goes to seams if given.
+int StretchInParallel(const std::vector<float> &in, unsigned int chNum, unsigned int rate, double tempo,
+    unsigned int jobs, const StretchEngine &engine, std::vector<float> *out, std::vector<size_t> *seams = nullptr);
+
+// Mean log-spectral distance in dB between two renders over 2048-frame windows,
+// which unlike a sample difference doesn't count the phase drift that
+// restarting an engine at a segment leaves behind
+double SpectralDistance(const std::vector<float> &a, const std::vector<float> &b, unsigned int chNum);
+
+// The worst step at a seam in dB: the largest frame-to-frame difference over
+// the join and 5 ms around it, against the largest one in the 100 ms on either
+// side. A click shows as a positive value, a clean join stays at 0 dB or under.
+double SeamDiscontinuity(const std::vector<float> &out, const std::vector<size_t> &seams, unsigned int chNum,
+    unsigned int rate);
+
+#endif
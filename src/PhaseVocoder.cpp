@@ -0,0 +1,246 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Phase vocoder time stretching and pitch shifting.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "PhaseVocoder.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+static const lark::samples_t CHUNK = 1024;
+// Largest tempo / pitch analyzed, an analysis hop of 2 * m_size
+static const double MAX_RATIO = 8.0;
+
+// About 46 ms, rounded up to a power of two
+static unsigned int FftSize(unsigned int rate)
+{
+    unsigned int n = 256;
+    while (n < rate * 46 / 1000)
+        n <<= 1;
+    return n;
+}
+
+static inline float Wrap(float phase)
+{
+    return phase - (float)(2.0 * M_PI) * std::floor(phase / (float)(2.0 * M_PI) + 0.5f);
+}
+
+PhaseVocoder::PhaseVocoder(Stage *upstream, unsigned int chNum, unsigned int rate)
+    : Stage(upstream), m_chNum(chNum), m_size(FftSize(rate)), m_hop(m_size / 4), m_fft(m_size),
+      m_window(m_size), m_channels(chNum), m_frame(m_size), m_spectrum(m_size / 2 + 1),
+      m_mag(m_size / 2 + 1), m_phase(m_size / 2 + 1), m_chunk(CHUNK * chNum)
+{
+    // Periodic Hann, whose square overlapped at a quarter hop sums to 1.5
+    for (unsigned int i = 0; i < m_size; ++i)
+        m_window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / m_size));
+    m_peaks.reserve(m_size / 2 + 1);
+
+    // Room for the most Hop() and Pull() ever keep, so playing never
+    // reallocates them: Hop() caps the analysis hop at 2 * m_size and Pull()
+    // reads out at the pitch, which SetPitch() keeps within 0.25 to 4
+    for (auto &ch : m_channels) {
+        ch.in.reserve(17 * CHUNK + 3 * m_size);
+        ch.out.reserve(5 * m_size + 4);
+    }
+
+    Reset();
+}
+
+void PhaseVocoder::SetTempo(double tempo)
+{
+    m_tempo.store((float)std::min(std::max(tempo, 0.125), MAX_RATIO), std::memory_order_relaxed);
+}
+
+void PhaseVocoder::SetPitch(double pitch)
+{
+    m_pitch.store((float)std::min(std::max(pitch, 0.25), 4.0), std::memory_order_relaxed);
+}
+
+void PhaseVocoder::Reset()
+{
+    Stage::Reset();
+
+    // Start with the first input frame under the last hop of a full window
+    for (auto &ch : m_channels) {
+        ch.in.assign(m_size - m_hop, 0.0f);
+        ch.prevPhase.assign(m_size / 2 + 1, 0.0f);
+        ch.synthPhase.assign(m_size / 2 + 1, 0.0f);
+        ch.ola.assign(m_size, 0.0f);
+        ch.out.assign(1, 0.0f);
+    }
+    m_inBase = 0;
+    m_inAvail = m_size - m_hop;
+    m_inPos = 0;
+    m_hopFrac = 0.0;
+    m_first = true;
+    m_eof = false;
+    m_done = false;
+    m_outPos = 1.0;
+}
+
+// Buffers input up to frame end, returns false if it ended before
+bool PhaseVocoder::Fill(size_t end)
+{
+    while (m_inAvail < end) {
+        if (m_eof)
+            return false;
+        int ret = m_upstream->Pull(m_chunk.data(), CHUNK);
+        if (ret <= 0) {
+            m_eof = true;
+            return false;
+        }
+        // Frames that a long hop jumped over are never analyzed, drop them
+        const int skip = m_inAvail < m_inBase ? (int)std::min<size_t>(m_inBase - m_inAvail, ret) : 0;
+        for (unsigned int c = 0; c < m_chNum; ++c) {
+            ArenaVector<float> &in = m_channels[c].in;
+            const size_t at = in.size();
+            in.resize(at + ret - skip);
+            for (int i = skip; i < ret; ++i)
+                in[at + i - skip] = m_chunk[i * m_chNum + c];
+        }
+        m_inAvail += ret;
+    }
+    return true;
+}
+
+void PhaseVocoder::Hop()
+{
+    const unsigned int bins = m_size / 2 + 1;
+
+    if (!Fill(m_inPos + m_size) && m_inPos >= m_inAvail) {
+        // Nothing left to analyze, let the overlap out
+        for (auto &ch : m_channels)
+            ch.out.insert(ch.out.end(), ch.ola.begin(), ch.ola.begin() + (m_size - m_hop));
+        m_done = true;
+        return;
+    }
+
+    const float tempo = m_tempo.load(std::memory_order_relaxed);
+    const float pitch = m_pitch.load(std::memory_order_relaxed);
+    m_hopFrac += (double)m_hop * std::min(tempo / pitch, (float)MAX_RATIO);
+    const unsigned int analysisHop = (unsigned int)m_hopFrac;
+    m_hopFrac -= analysisHop;
+    const unsigned int cutoff = pitch > 1.0f ? (unsigned int)((bins - 1) / pitch) : bins - 1;
+
+    for (auto &ch : m_channels) {
+        const size_t offset = m_inPos - m_inBase;
+        const size_t avail = std::min<size_t>(m_size, ch.in.size() > offset ? ch.in.size() - offset : 0);
+        for (size_t i = 0; i < avail; ++i)
+            m_frame[i] = ch.in[offset + i] * m_window[i];
+        std::fill(m_frame.begin() + avail, m_frame.end(), 0.0f);
+        m_fft.Forward(m_frame.data(), m_spectrum.data());
+
+        for (unsigned int k = 0; k < bins; ++k) {
+            m_mag[k] = std::abs(m_spectrum[k]);
+            m_phase[k] = std::arg(m_spectrum[k]);
+        }
+
+        if (m_first) {
+            ch.synthPhase = m_phase;
+        } else {
+            // Advance the peaks by their measured frequencies
+            m_peaks.clear();
+            for (unsigned int k = 0; k < bins; ++k) {
+                const float m = m_mag[k];
+                if ((k < 1 || m > m_mag[k - 1]) && (k < 2 || m > m_mag[k - 2]) &&
+                    (k + 1 >= bins || m >= m_mag[k + 1]) && (k + 2 >= bins || m >= m_mag[k + 2]))
+                    m_peaks.push_back(k);
+            }
+            for (unsigned int p : m_peaks) {
+                const float omega = (float)(2.0 * M_PI) * p / m_size;
+                const float dev = Wrap(m_phase[p] - ch.prevPhase[p] - omega * analysisHop);
+                const float freq = omega + (analysisHop ? dev / analysisHop : 0.0f);
+                ch.synthPhase[p] = Wrap(ch.synthPhase[p] + freq * m_hop);
+            }
+
+            // and keep the bins around each peak at their original phase offsets
+            size_t next = 0;
+            for (unsigned int k = 0; k < bins && !m_peaks.empty(); ++k) {
+                while (next < m_peaks.size() && m_peaks[next] < k)
+                    ++next;
+                unsigned int p;
+                if (next == m_peaks.size())
+                    p = m_peaks.back();
+                else if (next == 0 || m_peaks[next] - k <= k - m_peaks[next - 1])
+                    p = m_peaks[next];
+                else
+                    p = m_peaks[next - 1];
+                if (k != p)
+                    ch.synthPhase[k] = Wrap(ch.synthPhase[p] + m_phase[k] - m_phase[p]);
+            }
+        }
+        ch.prevPhase = m_phase;
+
+        for (unsigned int k = 0; k < bins; ++k)
+            m_spectrum[k] = k <= cutoff ? std::polar(m_mag[k], ch.synthPhase[k]) : std::complex<float>();
+        m_fft.Inverse(m_spectrum.data(), m_frame.data());
+
+        for (unsigned int i = 0; i < m_size; ++i)
+            ch.ola[i] += m_frame[i] * m_window[i] * (1.0f / 1.5f);
+        ch.out.insert(ch.out.end(), ch.ola.begin(), ch.ola.begin() + m_hop);
+        std::copy(ch.ola.begin() + m_hop, ch.ola.end(), ch.ola.begin());
+        std::fill(ch.ola.end() - m_hop, ch.ola.end(), 0.0f);
+    }
+
+    m_first = false;
+    m_inPos += analysisHop;
+    if (m_inPos >= m_inAvail) {
+        // Hopped past everything buffered, Fill() skips up to m_inPos
+        for (auto &ch : m_channels)
+            ch.in.clear();
+        m_inBase = m_inPos;
+    } else if (m_inPos - m_inBase >= 16 * CHUNK) {
+        for (auto &ch : m_channels)
+            ch.in.erase(ch.in.begin(), ch.in.begin() + (m_inPos - m_inBase));
+        m_inBase = m_inPos;
+    }
+}
+
+int PhaseVocoder::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("PhaseVocoder");
+    const double pitch = m_pitch.load(std::memory_order_relaxed);
+    lark::samples_t n = 0;
+    while (n < frames) {
+        const size_t i = (size_t)m_outPos;
+        if (i + 2 < m_channels[0].out.size()) {
+            // Catmull-Rom between out[i] and out[i + 1]
+            const float t = (float)(m_outPos - i);
+            for (unsigned int c = 0; c < m_chNum; ++c) {
+                const float *p = &m_channels[c].out[i - 1];
+                out[n * m_chNum + c] = p[1] + 0.5f * t * (p[2] - p[0] +
+                    t * (2.0f * p[0] - 5.0f * p[1] + 4.0f * p[2] - p[3] + t * (3.0f * (p[1] - p[2]) + p[3] - p[0])));
+            }
+            ++n;
+            m_outPos += pitch;
+            continue;
+        }
+        if (m_done)
+            break;
+
+        if (i > 4 * m_size) {
+            for (auto &ch : m_channels)
+                ch.out.erase(ch.out.begin(), ch.out.begin() + (i - 1));
+            m_outPos -= i - 1;
+        }
+        Hop();
+    }
+    return n ? (int)n : lark::E_EOF;
+}
@@ -0,0 +1,94 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Phase vocoder time stretching and pitch shifting.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_PHASEVOCODER_H
+#define KPLAY_PHASEVOCODER_H
+
+#include "Fft.h"
+#include "Pipeline.h"
+#include <atomic>
+#include <complex>
+#include <vector>
+
+// Stretches time by 1 / tempo with a phase vocoder (Hann windows overlapping
+// by 75%, phases locked to the nearest spectral peak as in Laroche-Dolson),
+// and shifts the pitch by stretching further and reading the result faster.
+// Bins that would alias when reading faster are dropped from the synthesis.
+class PhaseVocoder : public Stage {
+public:
+    PhaseVocoder(Stage *upstream, unsigned int chNum, unsigned int rate);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    // Can be called from any thread while playing, tempo is kept within
+    // 0.125 to 8 and pitch within 0.25 to 4
+    void SetTempo(double tempo);
+    void SetPitch(double pitch);
+
+    // Frames the output lags the input by. A frame is complete once the last
+    // of the m_size / m_hop windows overlapping it has been added.
+    unsigned int Latency() const
+    {
+        return m_size - m_hop;
+    }
+
+private:
+    struct Channel {
+        ArenaVector<float> in;                      // input from m_inBase on
+        ArenaVector<float> prevPhase;               // analysis phase of the previous hop
+        ArenaVector<float> synthPhase;
+        ArenaVector<float> ola;                     // m_size samples being overlapped
+        ArenaVector<float> out;                     // synthesized, not read yet
+    };
+
+    bool Fill(size_t frames);
+    void Hop();
+
+    const unsigned int m_chNum;
+    const unsigned int m_size;                      // FFT size
+    const unsigned int m_hop;                       // synthesis hop
+    Fft m_fft;
+    ArenaVector<float> m_window;
+    ArenaVector<Channel> m_channels;
+
+    // Scratch
+    ArenaVector<float> m_frame;
+    ArenaVector<std::complex<float>> m_spectrum;
+    ArenaVector<float> m_mag;
+    ArenaVector<float> m_phase;
+    ArenaVector<unsigned int> m_peaks;
+    ArenaVector<float> m_chunk;
+
+    std::atomic<float> m_tempo { 1.0f };
+    std::atomic<float> m_pitch { 1.0f };
+
+    size_t m_inBase = 0;                            // input frame at Channel::in[0]
+    size_t m_inAvail = 0;                           // input frames buffered in total
+    size_t m_inPos = 0;                             // input frame of the next analysis
+    double m_hopFrac = 0.0;
+    bool m_first = true;
+    bool m_eof = false;
+    bool m_done = false;
+    double m_outPos = 1.0;                          // read position in Channel::out
+};
+
+#endif
@@ -0,0 +1,126 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * The in-process processing chain that feeds RouteA's stream-in block.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Pipeline.h"
+#include "AllocGuard.h"
+#include "Realtime.h"
+#include "Trace.h"
+#include <cstring>
+
+PcmSource::PcmSource(lark::DataProducer *producer, unsigned int bitsPerSample, unsigned int chNum, lark::samples_t maxFrames)
+    : m_producer(producer), m_bytesPerSample(bitsPerSample / 8), m_chNum(chNum), m_maxFrames(maxFrames),
+      m_raw(maxFrames * chNum * (bitsPerSample / 8))
+{
+}
+
+int PcmSource::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("PcmSource");
+    if (frames > m_maxFrames)
+        frames = m_maxFrames;
+
+    int ret = m_producer->Produce(m_raw.data(), frames, nullptr);
+    if (ret <= 0)
+        return ret == 0 ? lark::E_EOF : ret;
+
+    const size_t n = (size_t)ret * m_chNum;
+    switch (m_bytesPerSample) {
+    case 2: {
+        const int16_t *in = (const int16_t *)m_raw.data();
+        for (size_t i = 0; i < n; ++i)
+            out[i] = in[i] * (1.0f / 32768.0f);
+        break;
+    }
+    case 3: {
+        const uint8_t *in = (const uint8_t *)m_raw.data();
+        for (size_t i = 0; i < n; ++i, in += 3) {
+            int32_t v = (int32_t)((uint32_t)in[0] << 8 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 24);
+            out[i] = (v >> 8) * (1.0f / 8388608.0f);
+        }
+        break;
+    }
+    case 4: {
+        const int32_t *in = (const int32_t *)m_raw.data();
+        for (size_t i = 0; i < n; ++i)
+            out[i] = in[i] * (1.0f / 2147483648.0f);
+        break;
+    }
+    default:
+        memset(out, 0, n * sizeof(float));
+        break;
+    }
+    return ret;
+}
+
+void Pipeline::Reset()
+{
+    std::lock_guard<std::mutex> _l(m_mutex);
+    if (m_tail)
+        m_tail->Reset();
+}
+
+void Pipeline::Arm()
+{
+    std::lock_guard<std::mutex> _l(m_mutex);
+    m_armed = true;
+    m_armedAt = std::chrono::steady_clock::now();
+    m_firstFrameUs = -1;
+}
+
+int Pipeline::Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp)
+{
+    (void)blocking;
+    if (timestamp)
+        *timestamp = -1;
+    realtime::EnterAudioThread();
+    allocguard::EnterAudioThread();
+    trace::NameThread("route");
+    trace::Span span("Produce");
+
+    std::lock_guard<std::mutex> _l(m_mutex);
+    if (!m_tail)
+        return lark::E_EOF;
+
+    // The route always asks for a whole frame, so keep pulling
+    // until it's filled and pad the last one with silence
+    float *out = (float *)data;
+    const bool steady = !m_armed && arena::Enabled();
+    const uint64_t faults = steady ? arena::ThreadFaults() : 0;
+    lark::samples_t filled = 0;
+    while (filled < samples) {
+        int ret = m_tail->Pull(out + filled * m_chNum, samples - filled);
+        if (ret <= 0)
+            break;
+        filled += ret;
+    }
+    if (steady)
+        arena::CountFaults(arena::ThreadFaults() - faults);
+    if (filled == 0)
+        return lark::E_EOF;
+    if (m_armed) {
+        m_armed = false;
+        m_firstFrameUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_armedAt).count();
+    }
+    if (filled < samples)
+        memset(out + filled * m_chNum, 0, (samples - filled) * m_chNum * sizeof(float));
+    return samples;
+}
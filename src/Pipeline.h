@@ -0,0 +1,100 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * The in-process processing chain that feeds RouteA's stream-in block.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_PIPELINE_H
+#define KPLAY_PIPELINE_H
+
+#include <lark/lark.h>
+#include "Arena.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// A processing stage working on interleaved float frames.
+// Stages are chained by their upstream pointers and pulled from the tail.
+class Stage {
+public:
+    explicit Stage(Stage *upstream = nullptr) : m_upstream(upstream) { }
+    virtual ~Stage() { }
+
+    // Fills out with up to frames frames.
+    // Returns the number of frames filled, or lark::E_EOF.
+    virtual int Pull(float *out, lark::samples_t frames) = 0;
+
+    // Drops any internal history, e.g. after seeking
+    virtual void Reset()
+    {
+        if (m_upstream)
+            m_upstream->Reset();
+    }
+
+protected:
+    Stage *m_upstream;
+};
+
+// The head stage: reads integer PCM from a DataProducer and converts it to float
+class PcmSource : public Stage {
+public:
+    PcmSource(lark::DataProducer *producer, unsigned int bitsPerSample, unsigned int chNum, lark::samples_t maxFrames);
+    virtual int Pull(float *out, lark::samples_t frames) override;
+
+private:
+    lark::DataProducer *m_producer;
+    unsigned int m_bytesPerSample;
+    unsigned int m_chNum;
+    lark::samples_t m_maxFrames;
+    ArenaVector<char> m_raw;
+};
+
+// Exposes the tail stage to lark as a FLOAT DataProducer
+class Pipeline : public lark::DataProducer {
+public:
+    void SetTail(Stage *tail, unsigned int chNum)
+    {
+        std::lock_guard<std::mutex> _l(m_mutex);
+        m_tail = tail;
+        m_chNum = chNum;
+    }
+
+    void Reset();
+
+    // Starts timing until the next frame is produced, e.g. when a file is picked
+    void Arm();
+
+    // Milliseconds from Arm() to the first frame produced after it, negative until then
+    double FirstFrameMs() const
+    {
+        return m_firstFrameUs.load() / 1000.0;
+    }
+
+private:
+    virtual int Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp) override;
+
+    Stage *m_tail = nullptr;
+    unsigned int m_chNum = 0;
+    std::mutex m_mutex;
+    bool m_armed = false;
+    std::chrono::steady_clock::time_point m_armedAt;
+    std::atomic<int64_t> m_firstFrameUs { -1 };
+};
+
+#endif
@@ -0,0 +1,103 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * In-process stages that run on RouteA's output.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "PostChain.h"
+#include "AllocGuard.h"
+#include "Realtime.h"
+#include "Trace.h"
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+int PostChain::Input::Pull(float *out, lark::samples_t frames)
+{
+    const lark::samples_t n = std::min(frames, m_frames);
+    memcpy(out, m_data, (size_t)n * m_chNum * sizeof(float));
+    m_data += (size_t)n * m_chNum;
+    m_frames -= n;
+    return n;
+}
+
+PostChain::PostChain(unsigned int chNum, lark::samples_t maxFrames)
+    : m_chNum(chNum), m_maxFrames(maxFrames), m_out((size_t)maxFrames * chNum)
+{
+}
+
+void PostChain::EnableQueue(lark::samples_t queueFrames)
+{
+    m_queue.reset(new RingBuffer((size_t)queueFrames * m_chNum * sizeof(float)));
+}
+
+int PostChain::Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp)
+{
+    (void)blocking;
+    realtime::EnterAudioThread();
+    allocguard::EnterAudioThread();
+    trace::Span span("PostChain");
+
+    std::lock_guard<std::mutex> _l(m_mutex);
+    const float *in = (const float *)data;
+    for (lark::samples_t done = 0; done < samples; ) {
+        const lark::samples_t n = std::min(samples - done, m_maxFrames);
+        const float *out = in + (size_t)done * m_chNum;
+        if (m_tail) {
+            // Every stage passes as many frames on as it pulls
+            m_input.Set(out, n, m_chNum);
+            lark::samples_t filled = 0;
+            while (filled < n) {
+                int ret = m_tail->Pull(m_out.data() + (size_t)filled * m_chNum, n - filled);
+                if (ret <= 0)
+                    break;
+                filled += ret;
+            }
+            if (filled < n)
+                memset(m_out.data() + (size_t)filled * m_chNum, 0, (size_t)(n - filled) * m_chNum * sizeof(float));
+            out = m_out.data();
+        }
+
+        for (lark::DataConsumer *sink : m_sinks)
+            sink->Consume(out, n, timestamp);
+        if (m_queue) {
+            // Held back by RouteB playing
+            const size_t bytes = (size_t)n * m_chNum * sizeof(float);
+            while (!m_queue->Write(out, bytes))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        done += n;
+    }
+    return samples;
+}
+
+int PostChain::Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp)
+{
+    (void)blocking;
+    if (timestamp)
+        *timestamp = -1;
+    realtime::EnterAudioThread();
+    allocguard::EnterAudioThread();
+
+    const size_t bytes = (size_t)samples * m_chNum * sizeof(float);
+    const size_t queued = m_queue ? std::min(m_queue->Readable(), bytes) : 0;
+    if (queued)
+        m_queue->Read(data, queued);
+    memset((char *)data + queued, 0, bytes - queued);
+    return samples;
+}
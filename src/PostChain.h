@@ -0,0 +1,95 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * In-process stages that run on RouteA's output.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_POSTCHAIN_H
+#define KPLAY_POSTCHAIN_H
+
+#include "Pipeline.h"
+#include "RingBuffer.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs stages on float frames that RouteA has finished with, i.e. after the
+// stretch, gain and fade blocks. RouteA's stream-out block feeds it as a
+// DataConsumer, and the frames that come out of the tail are handed to the
+// sinks right away. For an output device, which has to be clocked by its own
+// route, they are queued as well for RouteB's stream-in block to read as a
+// DataProducer. Then RouteA waits for room in the queue, and RouteB plays
+// silence whenever RouteA is stopped.
+class PostChain : public lark::DataConsumer, public lark::DataProducer {
+public:
+    // Up to maxFrames frames are processed at a time
+    PostChain(unsigned int chNum, lark::samples_t maxFrames);
+
+    // The stage that the first stage pulls RouteA's frames from
+    Stage *Head()
+    {
+        return &m_input;
+    }
+
+    // Frames pass through unchanged while tail is nullptr
+    void SetTail(Stage *tail)
+    {
+        std::lock_guard<std::mutex> _l(m_mutex);
+        m_tail = tail;
+    }
+
+    // Must be called before RouteA starts
+    void AddSink(lark::DataConsumer *sink)
+    {
+        m_sinks.push_back(sink);
+    }
+    // Queues queueFrames frames at most for RouteB. Must be called before RouteA starts.
+    void EnableQueue(lark::samples_t queueFrames);
+
+private:
+    // Hands out the frames that Consume() was given
+    class Input : public Stage {
+    public:
+        void Set(const float *data, lark::samples_t frames, unsigned int chNum)
+        {
+            m_data = data;
+            m_frames = frames;
+            m_chNum = chNum;
+        }
+        virtual int Pull(float *out, lark::samples_t frames) override;
+
+    private:
+        const float *m_data = nullptr;
+        lark::samples_t m_frames = 0;
+        unsigned int m_chNum = 0;
+    };
+
+    virtual int Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp) override;
+    virtual int Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp) override;
+
+    const unsigned int m_chNum;
+    const lark::samples_t m_maxFrames;
+    Input m_input;
+    Stage *m_tail = nullptr;
+    std::mutex m_mutex;
+    std::vector<float> m_out;
+    std::vector<lark::DataConsumer *> m_sinks;
+    std::unique_ptr<RingBuffer> m_queue;
+};
+
+#endif
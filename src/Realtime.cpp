@@ -0,0 +1,188 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Real-time scheduling, CPU affinity and memory locking for the audio path.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Realtime.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace realtime {
+
+static bool ParseInt(const char *str, int *value)
+{
+    char *end;
+    long v = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || v < 0 || v > 4096)
+        return false;
+    *value = (int)v;
+    return true;
+}
+
+int ParseScheduling(const char *str, Settings *settings)
+{
+    const char *colon = strchr(str, ':');
+    if (!colon)
+        return -1;
+    const std::string name(str, colon - str);
+    if (name == "fifo")
+        settings->policy = SCHED_FIFO;
+    else if (name == "rr")
+        settings->policy = SCHED_RR;
+    else
+        return -1;
+    if (!ParseInt(colon + 1, &settings->priority))
+        return -1;
+    if (settings->priority < sched_get_priority_min(settings->policy) ||
+        settings->priority > sched_get_priority_max(settings->policy))
+        return -1;
+    return 0;
+}
+
+int ParseCpus(const char *str, Settings *settings)
+{
+    settings->cpus.clear();
+    std::string list(str);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        const std::string item = list.substr(pos, comma - pos);
+        const size_t dash = item.find('-');
+        int first, last;
+        if (dash == std::string::npos) {
+            if (!ParseInt(item.c_str(), &first))
+                return -1;
+            last = first;
+        } else if (!ParseInt(item.substr(0, dash).c_str(), &first) ||
+                   !ParseInt(item.substr(dash + 1).c_str(), &last) || last < first) {
+            return -1;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            settings->cpus.push_back(cpu);
+        pos = comma + 1;
+    }
+    return settings->cpus.empty() ? -1 : 0;
+}
+
+int Apply(const Settings &settings, std::string *error)
+{
+    if (settings.policy >= 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = settings.priority;
+        int err = pthread_setschedparam(pthread_self(), settings.policy, &param);
+        if (err) {
+            *error = std::string("can't switch to ") + (settings.policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR") +
+                " priority " + std::to_string(settings.priority) + ": " + strerror(err);
+            if (err == EPERM)
+                *error += " (needs CAP_SYS_NICE or an rtprio limit in /etc/security/limits.conf)";
+            return -1;
+        }
+    }
+
+    if (!settings.cpus.empty()) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : settings.cpus) {
+            if (cpu >= CPU_SETSIZE) {
+                *error = "CPU " + std::to_string(cpu) + " is out of range";
+                return -1;
+            }
+            CPU_SET(cpu, &set);
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err) {
+            *error = std::string("can't pin to the CPUs given: ") + strerror(err);
+            if (err == EINVAL)
+                *error += " (none of them is online or allowed)";
+            return -1;
+        }
+#else
+        *error = "CPU affinity isn't supported on this platform";
+        return -1;
+#endif
+    }
+    return 0;
+}
+
+int Probe(const Settings &settings, std::string *error)
+{
+    int ret;
+    std::thread probe([&]() { ret = Apply(settings, error); });
+    probe.join();
+    return ret;
+}
+
+int LockMemory(std::string *error)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        const int err = errno;
+        *error = std::string("can't lock memory: ") + strerror(err);
+        if (err == ENOMEM || err == EPERM)
+            *error += " (raise the memlock limit with ulimit -l or in /etc/security/limits.conf)";
+        return -1;
+    }
+    return 0;
+}
+
+static Settings s_audio;
+static std::atomic<bool> s_audioSet { false };
+static thread_local bool t_entered = false;
+static std::mutex s_mutex;
+static unsigned int s_failures = 0;
+static std::string s_lastError;
+
+void SetAudioSettings(const Settings &settings)
+{
+    s_audio = settings;
+    s_audioSet = settings.policy >= 0 || !settings.cpus.empty();
+}
+
+void EnterAudioThread()
+{
+    if (t_entered || !s_audioSet.load(std::memory_order_relaxed))
+        return;
+    t_entered = true;
+    std::string error;
+    if (Apply(s_audio, &error) < 0) {
+        std::lock_guard<std::mutex> _l(s_mutex);
+        ++s_failures;
+        s_lastError = error;
+    }
+}
+
+unsigned int AudioFailures(std::string *error)
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    *error = s_lastError;
+    return s_failures;
+}
+
+}
@@ -0,0 +1,60 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Real-time scheduling, CPU affinity and memory locking for the audio path.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_REALTIME_H
+#define KPLAY_REALTIME_H
+
+#include <string>
+#include <vector>
+
+namespace realtime {
+
+struct Settings {
+    int policy = -1;            // SCHED_FIFO or SCHED_RR, -1 leaves scheduling alone
+    int priority = 0;
+    std::vector<int> cpus;      // empty leaves affinity alone
+};
+
+// Parses fifo:PRIORITY or rr:PRIORITY
+int ParseScheduling(const char *str, Settings *settings);
+// Parses CPUs like 2,3 or 2-5
+int ParseCpus(const char *str, Settings *settings);
+
+// Applies settings to the calling thread, describing the first problem in error
+int Apply(const Settings &settings, std::string *error);
+
+// Checks that settings can be applied by applying them to a short-lived thread
+int Probe(const Settings &settings, std::string *error);
+
+// Locks every page, now and to come, into memory
+int LockMemory(std::string *error);
+
+// The audio path's threads belong to lark, so they pick the settings up
+// themselves when they first enter kplay's code through EnterAudioThread()
+void SetAudioSettings(const Settings &settings);
+void EnterAudioThread();
+
+// Threads that failed to take the settings so far, and why the last one did
+unsigned int AudioFailures(std::string *error);
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Float to integer PCM requantization with optional dither and noise shaping.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Requantizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Wannamaker's 3-tap F-weighted error feedback filter
+static const float s_shaper[3] = { 1.623f, -0.982f, 0.109f };
+
+Requantizer::Requantizer(unsigned int chNum, unsigned int bitsPerSample, Dither dither)
+    : m_chNum(chNum), m_bytesPerSample(bitsPerSample / 8),
+      // Dither only makes sense above the float mantissa's resolution
+      m_dither(bitsPerSample <= 24 ? dither : NONE),
+      m_err(chNum * 3, 0.0f)
+{
+    m_rng[0] = 0x9e3779b9u;
+    m_rng[1] = 0x7f4a7c15u;
+    m_rng[2] = 0x85ebca6bu;
+    m_rng[3] = 0xc2b2ae35u;
+}
+
+int Requantizer::ParseDither(const char *str, Dither *dither)
+{
+    if (strcmp(str, "none") == 0) {
+        *dither = NONE;
+    } else if (strcmp(str, "tpdf") == 0) {
+        *dither = TPDF;
+    } else if (strcmp(str, "shaped") == 0) {
+        *dither = SHAPED;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void Requantizer::FillNoise(size_t n)
+{
+    // TPDF noise of +-1 LSB is the difference of two uniform variables
+    n = (n + 3) & ~(size_t)3;
+    if (m_noise.size() < n)
+        m_noise.resize(n);
+
+    uint32_t s[4] = { m_rng[0], m_rng[1], m_rng[2], m_rng[3] };
+    float *noise = m_noise.data();
+    const float k = 1.0f / 4294967296.0f;
+    for (size_t i = 0; i < n; i += 4) {
+        float u[2][4];
+        for (int r = 0; r < 2; ++r) {
+            for (int l = 0; l < 4; ++l) {
+                s[l] ^= s[l] << 13;
+                s[l] ^= s[l] >> 17;
+                s[l] ^= s[l] << 5;
+                u[r][l] = s[l] * k;
+            }
+        }
+        for (int l = 0; l < 4; ++l)
+            noise[i + l] = u[0][l] - u[1][l];
+    }
+    memcpy(m_rng, s, sizeof(m_rng));
+}
+
+void Requantizer::Process(const float *in, size_t frames, void *out)
+{
+    const size_t n = frames * m_chNum;
+    double scale;
+    int32_t qmax;
+    switch (m_bytesPerSample) {
+    case 2:
+        scale = 32768.0;
+        qmax = 32767;
+        break;
+    case 3:
+        scale = 8388608.0;
+        qmax = 8388607;
+        break;
+    default:
+        scale = 2147483648.0;
+        qmax = 2147483647;
+        break;
+    }
+    const float fscale = (float)scale;
+
+    if (m_dither != NONE)
+        FillNoise(n);
+
+    uint8_t *dst = (uint8_t *)out;
+    for (size_t i = 0; i < n; ++i) {
+        int32_t q;
+        if (m_dither == NONE) {
+            double v = std::nearbyint(in[i] * scale);
+            q = v >= qmax ? qmax : (v <= -qmax - 1.0 ? -qmax - 1 : (int32_t)v);
+        } else {
+            float v = in[i] * fscale;
+            float *e = nullptr;
+            if (m_dither == SHAPED) {
+                e = &m_err[(i % m_chNum) * 3];
+                v -= s_shaper[0] * e[0] + s_shaper[1] * e[1] + s_shaper[2] * e[2];
+            }
+            float r = std::nearbyint(v + m_noise[i]);
+            q = r >= qmax ? qmax : (r <= -qmax - 1.0f ? -qmax - 1 : (int32_t)r);
+            if (e) {
+                e[2] = e[1];
+                e[1] = e[0];
+                // Bound the fed-back error so that clipping can't make the loop unstable
+                e[0] = std::max(-2.0f, std::min(2.0f, q - v));
+            }
+        }
+
+        switch (m_bytesPerSample) {
+        case 2:
+            ((int16_t *)dst)[i] = (int16_t)q;
+            break;
+        case 3:
+            dst[i * 3] = (uint8_t)q;
+            dst[i * 3 + 1] = (uint8_t)(q >> 8);
+            dst[i * 3 + 2] = (uint8_t)(q >> 16);
+            break;
+        default:
+            ((int32_t *)dst)[i] = q;
+            break;
+        }
+    }
+}
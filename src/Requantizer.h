@@ -0,0 +1,61 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Float to integer PCM requantization with optional dither and noise shaping.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_REQUANTIZER_H
+#define KPLAY_REQUANTIZER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class Requantizer {
+public:
+    enum Dither { NONE, TPDF, SHAPED };
+
+    Requantizer(unsigned int chNum, unsigned int bitsPerSample, Dither dither);
+
+    // Converts frames interleaved float frames into packed little-endian PCM
+    void Process(const float *in, size_t frames, void *out);
+
+    size_t FrameBytes() const
+    {
+        return m_chNum * m_bytesPerSample;
+    }
+
+    static int ParseDither(const char *str, Dither *dither);
+
+private:
+    void FillNoise(size_t n);
+
+    const unsigned int m_chNum;
+    const unsigned int m_bytesPerSample;
+    const Dither m_dither;
+
+    // Four independent xorshift32 lanes, laid out so that the compiler can
+    // keep them in one vector register
+    uint32_t m_rng[4];
+    std::vector<float> m_noise;
+
+    // Error feedback history per channel for noise shaping
+    std::vector<float> m_err;
+};
+
+#endif
@@ -0,0 +1,176 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Polyphase windowed-sinc sample-rate converter.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Resampler.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const struct {
+    const char *name;
+    unsigned int taps;      // per phase
+    unsigned int phases;
+    double beta;            // of the Kaiser window
+    double cutoff;          // relative to the lower Nyquist frequency
+} s_presets[] = {
+    { "low",     8,  64,  5.0, 0.86 },
+    { "medium", 16, 128,  7.0, 0.91 },
+    { "high",   32, 256,  8.6, 0.95 },
+    { "best",   64, 512, 10.0, 0.97 },
+};
+
+// Zeroth order modified Bessel function of the first kind
+static double BesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+Resampler::Resampler(Stage *upstream, unsigned int chNum, unsigned int inRate, unsigned int outRate, Quality quality)
+    : Stage(upstream), m_chNum(chNum), m_inRate(inRate), m_outRate(outRate),
+      m_stepInt(inRate / outRate), m_stepFrac(inRate % outRate)
+{
+    m_taps = s_presets[quality].taps;
+    m_phases = s_presets[quality].phases;
+
+    // Row p holds the taps for a fractional delay of p / m_phases.
+    // One more row is kept so that adjacent rows can always be interpolated.
+    const double fc = s_presets[quality].cutoff * std::min(1.0, (double)outRate / inRate);
+    const double beta = s_presets[quality].beta;
+    const double half = m_taps / 2.0;
+    m_filter.resize((m_phases + 1) * m_taps);
+    for (unsigned int p = 0; p <= m_phases; ++p) {
+        float *row = &m_filter[p * m_taps];
+        double sum = 0.0;
+        for (unsigned int k = 0; k < m_taps; ++k) {
+            const double x = (double)k - (half - 1.0) - (double)p / m_phases;
+            const double y = M_PI * fc * x;
+            const double sinc = (y == 0.0) ? 1.0 : std::sin(y) / y;
+            const double r = x / half;
+            const double win = (r * r < 1.0) ? BesselI0(beta * std::sqrt(1.0 - r * r)) / BesselI0(beta) : 0.0;
+            row[k] = (float)(sinc * win);
+            sum += row[k];
+        }
+        for (unsigned int k = 0; k < m_taps; ++k)
+            row[k] = (float)(row[k] / sum);
+    }
+
+    m_chunk.resize(CHUNK * m_chNum);
+    m_hist.resize(m_chNum);
+    for (auto &h : m_hist)
+        h.resize(2 * m_taps + CHUNK + m_stepInt + 1);
+
+    Reset();
+}
+
+int Resampler::ParseQuality(const char *str, Quality *quality)
+{
+    for (size_t i = 0; i < sizeof(s_presets) / sizeof(s_presets[0]); ++i) {
+        if (strcmp(str, s_presets[i].name) == 0) {
+            *quality = (Quality)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void Resampler::Reset()
+{
+    Stage::Reset();
+
+    // Prime the history so that the first output frame is centered on the first input frame
+    m_avail = m_taps / 2 - 1;
+    for (auto &h : m_hist)
+        std::fill(h.begin(), h.begin() + m_avail, 0.0f);
+    m_pos = 0;
+    m_frac = 0;
+    m_eof = false;
+}
+
+bool Resampler::Refill()
+{
+    const size_t base = std::min(m_pos, m_avail);
+    for (auto &h : m_hist)
+        memmove(h.data(), h.data() + base, (m_avail - base) * sizeof(float));
+    m_avail -= base;
+    m_pos -= base;
+
+    if (m_eof)
+        return false;
+
+    int ret = m_upstream->Pull(m_chunk.data(), CHUNK);
+    if (ret <= 0) {
+        // Flush the filter tail out with silence
+        m_eof = true;
+        for (auto &h : m_hist)
+            std::fill(h.begin() + m_avail, h.begin() + m_avail + m_taps / 2, 0.0f);
+        m_avail += m_taps / 2;
+        return true;
+    }
+
+    for (unsigned int c = 0; c < m_chNum; ++c) {
+        float *dst = m_hist[c].data() + m_avail;
+        const float *src = m_chunk.data() + c;
+        for (int i = 0; i < ret; ++i)
+            dst[i] = src[i * m_chNum];
+    }
+    m_avail += ret;
+    return true;
+}
+
+int Resampler::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("Resampler");
+    lark::samples_t n = 0;
+    for (; n < frames; ++n) {
+        while (m_pos + m_taps > m_avail) {
+            if (!Refill())
+                return n ? (int)n : lark::E_EOF;
+        }
+
+        const uint64_t ph = (uint64_t)m_frac * m_phases;
+        const float *h0 = &m_filter[(ph / m_outRate) * m_taps];
+        const float *h1 = h0 + m_taps;
+        const float a = (float)(ph % m_outRate) / m_outRate;
+        for (unsigned int c = 0; c < m_chNum; ++c) {
+            const float *x = m_hist[c].data() + m_pos;
+            const float y0 = simd::Dot(x, h0, m_taps);
+            const float y1 = simd::Dot(x, h1, m_taps);
+            out[n * m_chNum + c] = y0 + a * (y1 - y0);
+        }
+
+        m_pos += m_stepInt;
+        m_frac += m_stepFrac;
+        if (m_frac >= m_outRate) {
+            m_frac -= m_outRate;
+            ++m_pos;
+        }
+    }
+    return n;
+}
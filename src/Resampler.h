@@ -0,0 +1,62 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Polyphase windowed-sinc sample-rate converter.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_RESAMPLER_H
+#define KPLAY_RESAMPLER_H
+
+#include "Pipeline.h"
+
+class Resampler : public Stage {
+public:
+    enum Quality { LOW, MEDIUM, HIGH, BEST };
+
+    Resampler(Stage *upstream, unsigned int chNum, unsigned int inRate, unsigned int outRate, Quality quality);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    static int ParseQuality(const char *str, Quality *quality);
+
+private:
+    bool Refill();
+
+    const unsigned int m_chNum;
+    const unsigned int m_inRate;
+    const unsigned int m_outRate;
+    unsigned int m_taps = 0;        // per phase, a multiple of 8
+    unsigned int m_phases = 0;
+    ArenaVector<float> m_filter;    // (m_phases + 1) rows of m_taps
+
+    // The input position of the next output frame is
+    // m_pos + m_frac / m_outRate, in m_hist coordinates
+    unsigned int m_stepInt;
+    unsigned int m_stepFrac;
+    size_t m_pos = 0;
+    unsigned int m_frac = 0;
+
+    static const lark::samples_t CHUNK = 1024;
+    ArenaVector<float> m_chunk;                 // interleaved, from upstream
+    std::vector<ArenaVector<float>> m_hist;     // planar input history
+    size_t m_avail = 0;
+    bool m_eof = false;
+};
+
+#endif
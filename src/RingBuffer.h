@@ -0,0 +1,100 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Lock-free single-producer single-consumer byte ring.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_RINGBUFFER_H
+#define KPLAY_RINGBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// One thread writes, another thread reads, neither of them ever blocks
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        m_buf.resize(size);
+        m_mask = size - 1;
+    }
+
+    size_t Capacity() const
+    {
+        return m_buf.size();
+    }
+
+    size_t Readable() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    // Producer side. Writes all of data, or nothing if there isn't enough room.
+    bool Write(const void *data, size_t bytes)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        if (m_buf.size() - (head - tail) < bytes)
+            return false;
+
+        const size_t pos = head & m_mask;
+        const size_t first = std::min(bytes, m_buf.size() - pos);
+        memcpy(&m_buf[pos], data, first);
+        memcpy(&m_buf[0], (const char *)data + first, bytes - first);
+        m_head.store(head + bytes, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns the readable bytes that are contiguous in memory.
+    const char *Peek(size_t *bytes) const
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t pos = tail & m_mask;
+        *bytes = std::min(Readable(), m_buf.size() - pos);
+        return &m_buf[pos];
+    }
+
+    void Release(size_t bytes)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+    }
+
+    // Consumer side. Copies out exactly bytes, which must be readable.
+    void Read(void *data, size_t bytes)
+    {
+        size_t first;
+        const char *p = Peek(&first);
+        first = std::min(first, bytes);
+        memcpy(data, p, first);
+        memcpy((char *)data + first, &m_buf[0], bytes - first);
+        Release(bytes);
+    }
+
+private:
+    std::vector<char> m_buf;
+    size_t m_mask;
+    std::atomic<size_t> m_head { 0 };   // total bytes written
+    std::atomic<size_t> m_tail { 0 };   // total bytes read
+};
+
+#endif
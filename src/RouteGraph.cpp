@@ -0,0 +1,319 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Route topologies described in text rather than code.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "RouteGraph.h"
+#include "Startup.h"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static const unsigned int MAX_PORT = 64;
+static const unsigned int MAX_CHANNELS = 32;
+
+static bool ParseUnsigned(const std::string &str, unsigned int max, unsigned int *value)
+{
+    char *end;
+    unsigned long v = strtoul(str.c_str(), &end, 10);
+    if (str.empty() || *end != '\0' || v > max)
+        return false;
+    *value = (unsigned int)v;
+    return true;
+}
+
+static std::vector<std::string> Split(const std::string &str, char sep)
+{
+    std::vector<std::string> parts;
+    std::stringstream ss(str);
+    std::string part;
+    while (std::getline(ss, part, sep))
+        parts.push_back(part);
+    return parts;
+}
+
+int RouteGraph::ParseEndpoint(const std::string &token, size_t *block, unsigned int *port, std::string *error) const
+{
+    const size_t dot = token.find('.');
+    const std::string name = token.substr(0, dot);
+    auto it = m_index.find(name);
+    if (it == m_index.end()) {
+        *error = "unknown block " + name;
+        return -1;
+    }
+    *block = it->second;
+    *port = 0;
+    if (dot != std::string::npos && !ParseUnsigned(token.substr(dot + 1), MAX_PORT - 1, port)) {
+        *error = "invalid port in " + token;
+        return -1;
+    }
+    return 0;
+}
+
+int RouteGraph::Parse(const char *text, const std::set<std::string> &flags,
+    const std::map<std::string, std::string> &vars, std::string *error)
+{
+    m_blocks.clear();
+    m_index.clear();
+    m_links.clear();
+    m_params.clear();
+    m_used.clear();
+    bool hasOutput = false;
+
+    std::stringstream lines(text);
+    std::string line;
+    for (unsigned int n = 1; std::getline(lines, line); ++n) {
+        std::string why;
+        auto fail = [&](const std::string &msg) {
+            *error = "line " + std::to_string(n) + ": " + msg;
+            return -1;
+        };
+
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        std::stringstream ss(line);
+        std::vector<std::string> tokens;
+        for (std::string token; ss >> token; )
+            tokens.push_back(token);
+        if (tokens.empty())
+            continue;
+
+        // Skip statements whose conditions don't hold
+        if (tokens[0].back() == ':') {
+            bool holds = true;
+            for (const std::string &cond : Split(tokens[0].substr(0, tokens[0].size() - 1), ',')) {
+                const bool negated = !cond.empty() && cond[0] == '!';
+                if ((flags.count(negated ? cond.substr(1) : cond) != 0) == negated)
+                    holds = false;
+            }
+            if (!holds)
+                continue;
+            tokens.erase(tokens.begin());
+            if (tokens.empty())
+                return fail("nothing after the condition");
+        }
+
+        for (std::string &token : tokens) {
+            if (token[0] != '$')
+                continue;
+            auto it = vars.find(token.substr(1));
+            if (it == vars.end())
+                return fail("unknown variable " + token);
+            ++m_used[it->first];
+            token = it->second;
+        }
+
+        const std::string &keyword = tokens[0];
+        if (keyword == "block") {
+            if (tokens.size() < 3)
+                return fail("block needs a name and a library");
+            if (m_index.count(tokens[1]))
+                return fail("block " + tokens[1] + " defined twice");
+            if (tokens[1].find('.') != std::string::npos)
+                return fail("block names can't have '.'");
+            BlockDesc desc;
+            desc.name = tokens[1];
+            desc.libraries = Split(tokens[2], '|');
+            desc.args.assign(tokens.begin() + 3, tokens.end());
+            m_index[desc.name] = m_blocks.size();
+            m_blocks.push_back(desc);
+        } else if (keyword == "link") {
+            if (tokens.size() < 3)
+                return fail("link needs two blocks");
+            LinkDesc link { 0, 0, 0, 0, 0, false };
+            if (ParseEndpoint(tokens[1], &link.from, &link.fromPort, &why) < 0 ||
+                ParseEndpoint(tokens[2], &link.to, &link.toPort, &why) < 0)
+                return fail(why);
+            for (size_t i = 3; i < tokens.size(); ++i) {
+                if (tokens[i].compare(0, 9, "channels=") == 0) {
+                    if (!ParseUnsigned(tokens[i].substr(9), MAX_CHANNELS, &link.channels) || link.channels == 0)
+                        return fail("invalid " + tokens[i]);
+                } else if (tokens[i] == "format=native") {
+                    link.native = true;
+                } else if (tokens[i] != "format=float") {
+                    return fail("unknown link option " + tokens[i]);
+                }
+            }
+            for (const LinkDesc &other : m_links) {
+                if (other.to == link.to && other.toPort == link.toPort)
+                    return fail(tokens[2] + " linked twice");
+                if (other.from == link.from && other.fromPort == link.fromPort)
+                    return fail(tokens[1] + " linked twice");
+            }
+            m_blocks[link.from].hasOutput = true;
+            m_blocks[link.to].hasInput = true;
+            m_links.push_back(link);
+        } else if (keyword == "param") {
+            if (tokens.size() < 3)
+                return fail("param needs a block and an ID");
+            ParamDesc param;
+            unsigned int port;
+            unsigned int id;
+            if (ParseEndpoint(tokens[1], &param.block, &port, &why) < 0)
+                return fail(why);
+            if (!ParseUnsigned(tokens[2], 0xffff, &id))
+                return fail("invalid parameter ID " + tokens[2]);
+            param.id = (int)id;
+            param.values.assign(tokens.begin() + 3, tokens.end());
+            param.line = n;
+            m_params.push_back(param);
+        } else if (keyword == "output") {
+            if (tokens.size() != 2)
+                return fail("output needs one block");
+            if (hasOutput)
+                return fail("output given twice");
+            if (ParseEndpoint(tokens[1], &m_output, &m_outputPort, &why) < 0)
+                return fail(why);
+            hasOutput = true;
+        } else {
+            return fail("unknown statement " + keyword);
+        }
+    }
+
+    // Everything has to be connected and lead somewhere
+    if (m_blocks.empty()) {
+        *error = "no blocks";
+        return -1;
+    }
+    if (!hasOutput) {
+        *error = "no output";
+        return -1;
+    }
+    for (const LinkDesc &link : m_links) {
+        if (link.from == m_output && link.fromPort == m_outputPort) {
+            *error = "the output of " + m_blocks[m_output].name + " is linked as well";
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        if (!m_blocks[i].hasInput && !m_blocks[i].hasOutput && i != m_output) {
+            *error = "block " + m_blocks[i].name + " isn't linked";
+            return -1;
+        }
+    }
+    if (!m_blocks[m_output].hasInput) {
+        *error = "nothing reaches the output";
+        return -1;
+    }
+
+    // Take away the blocks with nothing linked into them until none are left,
+    // the ones that never run out of inputs are on a cycle
+    std::vector<unsigned int> inputs(m_blocks.size(), 0);
+    for (const LinkDesc &link : m_links)
+        ++inputs[link.to];
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        if (inputs[i] == 0)
+            ready.push_back(i);
+    }
+    size_t removed = 0;
+    while (!ready.empty()) {
+        const size_t i = ready.back();
+        ready.pop_back();
+        ++removed;
+        for (const LinkDesc &link : m_links) {
+            if (link.from == i && --inputs[link.to] == 0)
+                ready.push_back(link.to);
+        }
+    }
+    if (removed < m_blocks.size()) {
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            if (inputs[i] != 0) {
+                *error = "block " + m_blocks[i].name + " is linked in a cycle";
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int RouteGraph::Load(const char *fileName, const std::set<std::string> &flags,
+    const std::map<std::string, std::string> &vars, std::string *error)
+{
+    std::ifstream fin(fileName);
+    if (!fin) {
+        *error = std::string("can't read ") + fileName;
+        return -1;
+    }
+    std::stringstream text;
+    text << fin.rdbuf();
+    return Parse(text.str().c_str(), flags, vars, error);
+}
+
+int RouteGraph::Build(lark::Route *route, unsigned int rate, unsigned int chNum, lark::samples_t frameSize,
+    lark::SampleFormat nativeFormat, std::string *error)
+{
+    for (BlockDesc &desc : m_blocks) {
+        const bool source = !desc.hasInput;
+        const bool sink = !desc.hasOutput && &desc != &m_blocks[m_output];
+        for (const std::string &library : desc.libraries) {
+            desc.block = route->NewBlock((library + m_libSuffix).c_str(), source, sink, desc.args);
+            if (desc.block) {
+                desc.library = library;
+                break;
+            }
+        }
+        if (!desc.block) {
+            *error = "failed to new block " + desc.name + " from " + desc.libraries[0] + m_libSuffix;
+            return -1;
+        }
+        startup::Mark("block " + desc.name + " from " + desc.library + m_libSuffix);
+    }
+
+    for (const LinkDesc &link : m_links) {
+        if (!route->NewLink(rate, link.native ? nativeFormat : lark::SampleFormat_FLOAT,
+                link.channels ? link.channels : chNum, frameSize,
+                m_blocks[link.from].block, link.fromPort, m_blocks[link.to].block, link.toPort)) {
+            *error = "failed to link " + m_blocks[link.from].name + "." + std::to_string(link.fromPort) +
+                " to " + m_blocks[link.to].name + "." + std::to_string(link.toPort);
+            return -1;
+        }
+    }
+
+    startup::Mark("links created");
+
+    for (const ParamDesc &param : m_params) {
+        const BlockDesc &desc = m_blocks[param.block];
+        if (route->SetParameter(desc.block, param.id, param.values) < 0) {
+            *error = "line " + std::to_string(param.line) + ": block " + desc.name + " from " +
+                desc.library + m_libSuffix + " rejects parameter " + std::to_string(param.id);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+lark::Block *RouteGraph::Block(const std::string &name) const
+{
+    auto it = m_index.find(name);
+    return it == m_index.end() ? nullptr : m_blocks[it->second].block;
+}
+
+std::string RouteGraph::Library(const std::string &name) const
+{
+    auto it = m_index.find(name);
+    return it == m_index.end() ? "" : m_blocks[it->second].library;
+}
+
+lark::Block *RouteGraph::Output(unsigned int *port) const
+{
+    *port = m_outputPort;
+    return m_blocks.empty() ? nullptr : m_blocks[m_output].block;
+}
@@ -0,0 +1,116 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Route topologies described in text rather than code.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_ROUTEGRAPH_H
+#define KPLAY_ROUTEGRAPH_H
+
+#include <lark/lark.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// A route described one statement per line, '#' starting a comment:
+//
+//   block NAME LIBRARY[|FALLBACK] [ARG...]    a block from LIBRARY, or from FALLBACK
+//                                             if LIBRARY doesn't load, without suffix
+//   link FROM[.PORT] TO[.PORT] [channels=N] [format=float|native]
+//                                             a link, by default of every channel in float
+//   param NAME ID [VALUE...]                  a parameter set on block NAME once built
+//   output NAME[.PORT]                        where the output device is fed from
+//
+// A statement prefixed with COND[,COND...]: only counts when every COND is one
+// of the flags given, or !COND when it isn't. $VAR tokens are replaced by the
+// variables given. Blocks with no links into them are sources, and those with
+// no links out of them (except the output) are sinks. Links can't form a cycle.
+class RouteGraph {
+public:
+    explicit RouteGraph(const char *libSuffix) : m_libSuffix(libSuffix) { }
+
+    // Parses and checks the whole graph, describing the first problem in error
+    int Parse(const char *text, const std::set<std::string> &flags,
+        const std::map<std::string, std::string> &vars, std::string *error);
+    int Load(const char *fileName, const std::set<std::string> &flags,
+        const std::map<std::string, std::string> &vars, std::string *error);
+
+    // Creates every block and link in route, then sets the parameters. A
+    // parameter that its block rejects fails it, with the statement's line in error.
+    int Build(lark::Route *route, unsigned int rate, unsigned int chNum, lark::samples_t frameSize,
+        lark::SampleFormat nativeFormat, std::string *error);
+
+    bool Has(const std::string &name) const
+    {
+        return m_index.count(name) != 0;
+    }
+
+    // nullptr until built, or if there's no such block
+    lark::Block *Block(const std::string &name) const;
+
+    // The library NAME was built from, which is its fallback if the first one didn't load
+    std::string Library(const std::string &name) const;
+
+    lark::Block *Output(unsigned int *port) const;
+
+    // How many times $var appears in the statements that count
+    unsigned int Uses(const std::string &var) const
+    {
+        auto it = m_used.find(var);
+        return it == m_used.end() ? 0 : it->second;
+    }
+
+private:
+    struct BlockDesc {
+        std::string name;
+        std::vector<std::string> libraries;
+        lark::Parameters args;
+        bool hasInput = false;
+        bool hasOutput = false;
+        std::string library;            // the one built from
+        lark::Block *block = nullptr;
+    };
+    struct LinkDesc {
+        size_t from;
+        unsigned int fromPort;
+        size_t to;
+        unsigned int toPort;
+        unsigned int channels;          // 0 for every channel
+        bool native;
+    };
+    struct ParamDesc {
+        size_t block;
+        int id;
+        lark::Parameters values;
+        unsigned int line;
+    };
+
+    int ParseEndpoint(const std::string &token, size_t *block, unsigned int *port, std::string *error) const;
+
+    const std::string m_libSuffix;
+    std::vector<BlockDesc> m_blocks;
+    std::map<std::string, size_t> m_index;
+    std::vector<LinkDesc> m_links;
+    std::vector<ParamDesc> m_params;
+    std::map<std::string, unsigned int> m_used;
+    size_t m_output = 0;
+    unsigned int m_outputPort = 0;
+};
+
+#endif
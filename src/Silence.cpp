@@ -0,0 +1,111 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Leaves out leading, trailing and long stretches of silence.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Silence.h"
+#include "Simd.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SilenceStage::SilenceStage(Stage *upstream, unsigned int chNum, unsigned int rate, double thresholdDb,
+    uint64_t minFrames, bool skipGaps)
+    : Stage(upstream), m_chNum(chNum), m_threshold((float)std::pow(10.0, thresholdDb / 20.0)),
+      m_minFrames(minFrames), m_skipGaps(skipGaps), m_blockFrames(std::max(10/*ms*/ * rate / 1000, 1u)),
+      m_block(m_blockFrames * chNum)
+{
+}
+
+void SilenceStage::Reset()
+{
+    Stage::Reset();
+    m_blockPos = 0;
+    m_blockLen = 0;
+    m_inFrames = 0;
+    m_heard = false;
+    m_run = 0;
+    m_skipped = 0;
+    m_eof = false;
+}
+
+// Reads blocks until one is to be passed on, returning false at the end
+bool SilenceStage::Fill()
+{
+    while (!m_eof) {
+        if (m_inFrames >= m_end) {
+            m_eof = true;
+            break;
+        }
+        const int ret = m_upstream->Pull(m_block.data(), (lark::samples_t)std::min<uint64_t>(m_blockFrames, m_end - m_inFrames));
+        if (ret <= 0) {
+            m_eof = true;
+            break;
+        }
+        m_inFrames += ret;
+
+        float min = 0.0f;
+        float max = 0.0f;
+        simd::MinMax(m_block.data(), (size_t)ret * m_chNum, &min, &max);
+        const bool silent = -min < m_threshold && max < m_threshold;
+        if (!silent) {
+            m_heard = true;
+            m_run = 0;
+        } else {
+            m_run += ret;
+            if (!m_heard || (m_skipGaps && m_run > m_minFrames)) {
+                m_skipped += ret;
+                continue;
+            }
+        }
+        m_blockPos = 0;
+        m_blockLen = ret;
+        return true;
+    }
+    return false;
+}
+
+int SilenceStage::Pull(float *out, lark::samples_t frames)
+{
+    trace::Span span("SilenceStage");
+    lark::samples_t n = 0;
+    while (n < frames) {
+        if (m_blockPos == m_blockLen && !Fill())
+            break;
+        const lark::samples_t count = std::min(frames - n, m_blockLen - m_blockPos);
+        memcpy(out + n * m_chNum, m_block.data() + m_blockPos * m_chNum, count * m_chNum * sizeof(float));
+        m_blockPos += count;
+        n += count;
+    }
+    return n ? (int)n : lark::E_EOF;
+}
+
+uint64_t SilenceStage::LastSound(const Overview &overview, double thresholdDb)
+{
+    if (overview.Empty())
+        return 0;
+    const int threshold = Overview::Encode((float)std::pow(10.0, thresholdDb / 20.0));
+    const std::vector<Overview::Bin> &bins = overview.Level(0);
+    for (size_t i = bins.size(); i-- > 0; ) {
+        if (-bins[i].min >= threshold || bins[i].max >= threshold)
+            return std::min<uint64_t>((uint64_t)(i + 1) * Overview::BIN_FRAMES, overview.Frames());
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Leaves out leading, trailing and long stretches of silence.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_SILENCE_H
+#define KPLAY_SILENCE_H
+
+#include "Overview.h"
+#include "Pipeline.h"
+#include <cstdint>
+
+// Judges the input in 10 ms blocks, a block being silent when no sample
+// in it reaches the threshold. Every silent block before the first sound
+// is dropped, and with skipGaps every silent block after the first minFrames
+// of a gap, so long gaps shrink to minFrames and short ones stay as they
+// are. Whatever follows the input frame given to SetEnd() is dropped too.
+class SilenceStage : public Stage {
+public:
+    SilenceStage(Stage *upstream, unsigned int chNum, unsigned int rate, double thresholdDb,
+        uint64_t minFrames, bool skipGaps);
+
+    virtual int Pull(float *out, lark::samples_t frames) override;
+    virtual void Reset() override;
+
+    // Where the input's last sound ends, e.g. from an overview of the whole file
+    void SetEnd(uint64_t frame)
+    {
+        m_end = frame;
+    }
+
+    // Input frames dropped so far
+    uint64_t Skipped() const
+    {
+        return m_skipped;
+    }
+
+    // The input frame after which an overview shows nothing reaching thresholdDb,
+    // rounded up to its bins, or 0 if nothing does
+    static uint64_t LastSound(const Overview &overview, double thresholdDb);
+
+private:
+    bool Fill();
+
+    const unsigned int m_chNum;
+    const float m_threshold;
+    const uint64_t m_minFrames;
+    const bool m_skipGaps;
+    const lark::samples_t m_blockFrames;
+    ArenaVector<float> m_block;
+    lark::samples_t m_blockPos = 0;     // frames of m_block passed on
+    lark::samples_t m_blockLen = 0;     // frames in m_block
+    uint64_t m_inFrames = 0;
+    uint64_t m_end = UINT64_MAX;
+    bool m_heard = false;               // any sound yet
+    uint64_t m_run = 0;                 // frames of the current gap
+    uint64_t m_skipped = 0;
+    bool m_eof = false;
+};
+
+#endif
@@ -0,0 +1,186 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Small vector kernels shared by the processing stages.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_SIMD_H
+#define KPLAY_SIMD_H
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KPLAY_SIMD_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KPLAY_SIMD_NEON
+#endif
+
+namespace simd {
+
+// Four float lanes, for processing up to four channels side by side
+#if defined(KPLAY_SIMD_SSE)
+typedef __m128 F4;
+static inline F4 Set1(float v) { return _mm_set1_ps(v); }
+static inline F4 Load(const float *p) { return _mm_loadu_ps(p); }
+static inline void Store(float *p, F4 v) { _mm_storeu_ps(p, v); }
+static inline F4 Add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+static inline F4 Sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+static inline F4 Mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+#elif defined(KPLAY_SIMD_NEON)
+typedef float32x4_t F4;
+static inline F4 Set1(float v) { return vdupq_n_f32(v); }
+static inline F4 Load(const float *p) { return vld1q_f32(p); }
+static inline void Store(float *p, F4 v) { vst1q_f32(p, v); }
+static inline F4 Add(F4 a, F4 b) { return vaddq_f32(a, b); }
+static inline F4 Sub(F4 a, F4 b) { return vsubq_f32(a, b); }
+static inline F4 Mul(F4 a, F4 b) { return vmulq_f32(a, b); }
+#else
+struct F4 {
+    float v[4];
+};
+static inline F4 Set1(float v) { return F4 { { v, v, v, v } }; }
+static inline F4 Load(const float *p) { return F4 { { p[0], p[1], p[2], p[3] } }; }
+static inline void Store(float *p, F4 v) { for (int i = 0; i < 4; ++i) p[i] = v.v[i]; }
+static inline F4 Add(F4 a, F4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+static inline F4 Sub(F4 a, F4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline F4 Mul(F4 a, F4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+#endif
+
+// Returns the dot product of a and b, n must be a multiple of 8
+static inline float Dot(const float *a, const float *b, unsigned int n)
+{
+#if defined(KPLAY_SIMD_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (unsigned int i = 0; i < n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    float t[4];
+    _mm_storeu_ps(t, acc0);
+    return (t[0] + t[1]) + (t[2] + t[3]);
+#elif defined(KPLAY_SIMD_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (unsigned int i = 0; i < n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    float32x2_t s = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i < n; i += 4) {
+        acc[0] += a[i] * b[i];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+// Folds n interleaved samples into 4 lanes, sample i going to lane i % 4:
+// the largest magnitude into peak and the sum of squares into sumSq.
+// Both are accumulated into, so they must be initialized by the caller.
+static inline void PeakSumSq(const float *x, size_t n, float peak[4], float sumSq[4])
+{
+    size_t i = 0;
+#if defined(KPLAY_SIMD_SSE)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 pk = _mm_loadu_ps(peak);
+    __m128 sq = _mm_loadu_ps(sumSq);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 v = _mm_loadu_ps(x + i);
+        pk = _mm_max_ps(pk, _mm_and_ps(v, absMask));
+        sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+    }
+    _mm_storeu_ps(peak, pk);
+    _mm_storeu_ps(sumSq, sq);
+#elif defined(KPLAY_SIMD_NEON)
+    float32x4_t pk = vld1q_f32(peak);
+    float32x4_t sq = vld1q_f32(sumSq);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t v = vld1q_f32(x + i);
+        pk = vmaxq_f32(pk, vabsq_f32(v));
+        sq = vmlaq_f32(sq, v, v);
+    }
+    vst1q_f32(peak, pk);
+    vst1q_f32(sumSq, sq);
+#endif
+    for (; i < n; ++i) {
+        const float a = x[i] < 0.0f ? -x[i] : x[i];
+        if (a > peak[i % 4])
+            peak[i % 4] = a;
+        sumSq[i % 4] += x[i] * x[i];
+    }
+}
+
+// Extends min and max to cover n samples of x
+static inline void MinMax(const float *x, size_t n, float *min, float *max)
+{
+    size_t i = 0;
+    float lo = *min;
+    float hi = *max;
+#if defined(KPLAY_SIMD_SSE)
+    if (n >= 4) {
+        __m128 mn = _mm_set1_ps(lo);
+        __m128 mx = _mm_set1_ps(hi);
+        for (; i + 4 <= n; i += 4) {
+            const __m128 v = _mm_loadu_ps(x + i);
+            mn = _mm_min_ps(mn, v);
+            mx = _mm_max_ps(mx, v);
+        }
+        float t[4];
+        _mm_storeu_ps(t, mn);
+        lo = std::min(std::min(t[0], t[1]), std::min(t[2], t[3]));
+        _mm_storeu_ps(t, mx);
+        hi = std::max(std::max(t[0], t[1]), std::max(t[2], t[3]));
+    }
+#elif defined(KPLAY_SIMD_NEON)
+    if (n >= 4) {
+        float32x4_t mn = vdupq_n_f32(lo);
+        float32x4_t mx = vdupq_n_f32(hi);
+        for (; i + 4 <= n; i += 4) {
+            const float32x4_t v = vld1q_f32(x + i);
+            mn = vminq_f32(mn, v);
+            mx = vmaxq_f32(mx, v);
+        }
+        float t[4];
+        vst1q_f32(t, mn);
+        lo = std::min(std::min(t[0], t[1]), std::min(t[2], t[3]));
+        vst1q_f32(t, mx);
+        hi = std::max(std::max(t[0], t[1]), std::max(t[2], t[3]));
+    }
+#endif
+    for (; i < n; ++i) {
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    *min = lo;
+    *max = hi;
+}
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Timing of the phases kplay goes through before the first sample.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Startup.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace startup {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Phase {
+    std::string name;
+    Clock::time_point end;
+};
+
+static std::mutex s_mutex;
+static std::vector<Phase> s_phases;
+
+void Mark(const std::string &phase)
+{
+    MarkAt(phase, Clock::now());
+}
+
+void MarkAt(const std::string &phase, Clock::time_point when)
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    for (const Phase &p : s_phases) {
+        if (p.name == phase)
+            return;
+    }
+    s_phases.push_back({ phase, when });
+}
+
+std::string Report()
+{
+    std::vector<Phase> phases;
+    {
+        std::lock_guard<std::mutex> _l(s_mutex);
+        phases = s_phases;
+    }
+    if (phases.empty())
+        return "";
+    std::stable_sort(phases.begin(), phases.end(), [](const Phase &a, const Phase &b) { return a.end < b.end; });
+
+    auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    char line[128];
+    snprintf(line, sizeof(line), "%-44s %10s %10s\n", "PHASE", "AT ms", "TOOK ms");
+    std::string report = line;
+    for (size_t i = 0; i < phases.size(); ++i) {
+        snprintf(line, sizeof(line), "%-44s %10.2f %10.2f\n", phases[i].name.c_str(),
+            ms(phases[i].end - phases[0].end), i ? ms(phases[i].end - phases[i - 1].end) : 0.0);
+        report += line;
+    }
+    return report;
+}
+
+}
@@ -0,0 +1,43 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Timing of the phases kplay goes through before the first sample.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_STARTUP_H
+#define KPLAY_STARTUP_H
+
+#include <chrono>
+#include <string>
+
+namespace startup {
+
+// Records that phase ended now, on the monotonic clock. Phases are timed
+// from the first one recorded, and only the first phase of a name counts,
+// so marks on paths taken again for later files are ignored.
+// Can be called from any thread.
+void Mark(const std::string &phase);
+void MarkAt(const std::string &phase, std::chrono::steady_clock::time_point when);
+
+// Returns a table of the phases in time order, with when each one ended
+// and how long it took since the previous one, in ms
+std::string Report();
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-thread event recording dumped as a Chrome trace.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace trace {
+
+std::atomic<bool> g_enabled { false };
+
+struct Event {
+    const char *name;
+    int64_t ts;
+    int64_t dur;        // -1 for instants
+    int64_t value;
+};
+
+// Written by its own thread only, read by Write() once the thread is done
+struct Ring {
+    explicit Ring(size_t size, unsigned int tid) : events(size), tid(tid) { }
+    std::vector<Event> events;
+    std::atomic<size_t> count { 0 };
+    const unsigned int tid;
+    std::atomic<const char *> name { nullptr };
+};
+
+static std::mutex s_mutex;
+static std::vector<std::unique_ptr<Ring>> s_rings;
+static size_t s_eventsPerThread = 0;
+static thread_local Ring *t_ring = nullptr;
+
+void Enable(size_t eventsPerThread)
+{
+    std::lock_guard<std::mutex> _l(s_mutex);
+    s_eventsPerThread = eventsPerThread;
+    g_enabled = eventsPerThread > 0;
+}
+
+int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Ring *ThreadRing()
+{
+    if (!t_ring) {
+        std::lock_guard<std::mutex> _l(s_mutex);
+        s_rings.emplace_back(new Ring(s_eventsPerThread, (unsigned int)s_rings.size() + 1));
+        t_ring = s_rings.back().get();
+    }
+    return t_ring;
+}
+
+static void Record(const char *name, int64_t ts, int64_t dur, int64_t value)
+{
+    if (!Enabled())
+        return;
+    Ring *ring = ThreadRing();
+    const size_t n = ring->count.load(std::memory_order_relaxed);
+    ring->events[n % ring->events.size()] = { name, ts, dur, value };
+    ring->count.store(n + 1, std::memory_order_release);
+}
+
+void Complete(const char *name, int64_t start, int64_t dur)
+{
+    Record(name, start, dur, 0);
+}
+
+void Instant(const char *name, int64_t value)
+{
+    Record(name, Now(), -1, value);
+}
+
+void NameThread(const char *name)
+{
+    if (!Enabled())
+        return;
+    const char *none = nullptr;
+    ThreadRing()->name.compare_exchange_strong(none, name);
+}
+
+int Write(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "w");
+    if (!fp)
+        return -1;
+
+    std::lock_guard<std::mutex> _l(s_mutex);
+    const int pid = (int)getpid();
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    const char *sep = "";
+    for (const auto &ring : s_rings) {
+        if (ring->name) {
+            fprintf(fp, "%s{\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                sep, pid, ring->tid, ring->name.load());
+            sep = ",\n";
+        }
+
+        // The oldest ones are overwritten once the ring is full
+        const size_t count = ring->count.load(std::memory_order_acquire);
+        const size_t size = ring->events.size();
+        for (size_t i = count > size ? count - size : 0; i < count; ++i) {
+            const Event &e = ring->events[i % size];
+            if (e.dur >= 0) {
+                fprintf(fp, "%s{\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\",\"ts\":%lld,\"dur\":%lld}",
+                    sep, pid, ring->tid, e.name, (long long)e.ts, (long long)e.dur);
+            } else {
+                fprintf(fp, "%s{\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\",\"ts\":%lld,\"args\":{\"value\":%lld}}",
+                    sep, pid, ring->tid, e.name, (long long)e.ts, (long long)e.value);
+            }
+            sep = ",\n";
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+}
@@ -0,0 +1,75 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Per-thread event recording dumped as a Chrome trace.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KPLAY_TRACE_H
+#define KPLAY_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Events go to a ring of their own thread, which keeps the newest ones once
+// it's full, so recording takes no lock and never allocates after the
+// thread's first event. Names must be string literals, as only the pointers
+// are kept. Nothing is recorded until Enable().
+namespace trace {
+
+extern std::atomic<bool> g_enabled;
+
+inline bool Enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Enable(size_t eventsPerThread);
+
+// Microseconds on the monotonic clock
+int64_t Now();
+
+// A span of duration dur starting at start, and a point in time with a value
+void Complete(const char *name, int64_t start, int64_t dur);
+void Instant(const char *name, int64_t value);
+
+// Shown as the thread's name in the trace, the first name given sticks
+void NameThread(const char *name);
+
+// Writes every thread's events as a Chrome trace JSON, once all of them are done.
+// Returns -1 if fileName can't be written.
+int Write(const char *fileName);
+
+// Records the span of its own lifetime
+class Span {
+public:
+    explicit Span(const char *name) : m_name(name), m_start(Enabled() ? Now() : -1) { }
+    ~Span()
+    {
+        if (m_start >= 0)
+            Complete(m_name, m_start, Now() - m_start);
+    }
+
+private:
+    const char *m_name;
+    const int64_t m_start;
+};
+
+}
+
+#endif
@@ -21,12 +21,48 @@
 
 #include <lark/lark.h>
 #include <klogging.h>
+#include "Activity.h"
+#include "AllocGuard.h"
+#include "Arena.h"
+#include "Cache.h"
+#include "Equalizer.h"
+#include "FileSink.h"
+#include "Limiter.h"
+#include "Loudness.h"
+#include "Meter.h"
+#include "Overview.h"
+#include "ParallelStretch.h"
+#include "PhaseVocoder.h"
+#include "Pipeline.h"
+#include "PostChain.h"
+#include "Realtime.h"
+#include "Resampler.h"
+#include "RingBuffer.h"
+#include "RouteGraph.h"
+#include "Silence.h"
+#include "Startup.h"
+#include "Trace.h"
+#include "WavFormat.h"
+#ifdef KPLAY_HAVE_FLAC
+#include <FLAC/stream_decoder.h>
+#endif
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <termios.h>
+#include <atomic>
 #include <fstream>
+#include <map>
 #include <mutex>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <ctime>
 #include <cstring>
+#include <memory>
+#include <set>
 #include <thread>
+#include <vector>
 
 static const char *__version = "0.4";
 static bool s_silent = false;
@@ -47,44 +83,52 @@ static bool s_silent = false;
 #define SUFFIX ".so"
 #endif
 
-#define ID_RIFF 0x46464952
-#define ID_WAVE 0x45564157
-#define ID_FMT  0x20746d66
-#define ID_DATA 0x61746164
-#define FORMAT_PCM 1
-
-struct wav_header {
-    uint32_t riff_id;
-    uint32_t riff_sz;
-    uint32_t riff_fmt;
-    uint32_t fmt_id;
-    uint32_t fmt_sz;
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    uint32_t data_id;
-    uint32_t data_sz;
-};
+// RouteA unless -G gives another, see RouteGraph.h for the syntax
+static const char *DEFAULT_ROUTE =
+    "block in libblkstreamin $producer\n"
+    "block fadein libblkfadein\n"
+    "stereo: block deinterleave libblkdeinterleave\n"
+    "block gain libblkgain\n"
+    "stereo: block interleave libblkinterleave\n"
+    "block stretch $stretch\n"
+    "block fadeout libblkfadeout\n"
+    "save: block duplicator libblkduplicator\n"
+    "save: block saver libblkstreamout $savesink\n"
+    "\n"
+    "link in fadein\n"
+    "stereo: link fadein deinterleave\n"
+    "stereo: link deinterleave.0 gain.0 channels=1\n"
+    "stereo: link deinterleave.1 gain.1 channels=1\n"
+    "stereo: link gain.0 interleave.0 channels=1\n"
+    "stereo: link gain.1 interleave.1 channels=1\n"
+    "stereo: link interleave stretch\n"
+    "!stereo: link fadein gain\n"
+    "!stereo: link gain stretch\n"
+    "link stretch fadeout\n"
+    "save: link fadeout duplicator\n"
+    "save: link duplicator.1 saver\n"
+    "save: output duplicator\n"
+    "!save: output fadeout\n";
 
 enum Output { PORTAUDIO, ALSA, TINYALSA, STDOUT, NULLDEV };
+enum OutputFormat { AUTO, NATIVE, FLOAT };
 
 class Player;
 
-class WavFile : public lark::DataProducer {
+// The file to play, producing the integer PCM that Header() describes
+class AudioFile : public lark::DataProducer {
 public:
-    WavFile(Player *player) : m_player(player)
+    AudioFile(Player *player) : m_player(player)
     {
         memset(&m_header, 0, sizeof(m_header));
     }
-    int Open(const char *wavFileName);
-    void SeekToBegin();
+    virtual ~AudioFile() { }
 
-    operator bool() const
+    virtual int Open(const char *fileName) = 0;
+    virtual void SeekToBegin() = 0;
+    virtual bool Seekable() const
     {
-        return (!!m_fin) && m_sampleSize;
+        return true;
     }
 
     const struct wav_header &Header() const
@@ -92,17 +136,121 @@ public:
         return m_header;
     }
 
+protected:
+    // Reports the progress in 1/10000, or nothing when there's no player to show it
+    void ReportProgress(int64_t progress);
+
+    struct wav_header m_header;
+    Player *m_player;
+};
+
+class WavFile : public AudioFile {
+public:
+    WavFile(Player *player) : AudioFile(player) { }
+    virtual int Open(const char *wavFileName) override;
+    virtual void SeekToBegin() override;
+
+    operator bool() const
+    {
+        return (!!m_fin) && m_sampleSize;
+    }
+
 private:
     virtual int Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp) override;
 
     std::ifstream m_fin;
+    long m_dataOffset = 0;
     long m_pcmBytes = 0;
-    struct wav_header m_header;
     size_t m_sampleSize = 0;
     std::mutex m_mutex;
-    Player *m_player;
 };
 
+// Reads a wav stream from stdin or a pipe, which can't seek
+class WavStream : public AudioFile {
+public:
+    WavStream(Player *player) : AudioFile(player) { }
+    virtual ~WavStream();
+    // "-" is stdin
+    virtual int Open(const char *wavFileName) override;
+    virtual void SeekToBegin() override { }
+    virtual bool Seekable() const override
+    {
+        return false;
+    }
+
+private:
+    virtual int Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp) override;
+
+    size_t ReadFully(void *data, size_t bytes);
+    bool Skip(size_t bytes);
+
+    int m_fd = -1;
+    uint64_t m_pcmBytes = 0; // 0 if open-ended
+    uint64_t m_readBytes = 0;
+    size_t m_sampleSize = 0;
+};
+
+#ifdef KPLAY_HAVE_FLAC
+// Decodes a FLAC file ahead of playback on its own thread
+class FlacFile : public AudioFile {
+public:
+    FlacFile(Player *player) : AudioFile(player) { }
+    virtual ~FlacFile();
+    virtual int Open(const char *flacFileName) override;
+    virtual void SeekToBegin() override
+    {
+        Seek(0);
+    }
+
+    // Seeks to the given frame, using the file's SEEKTABLE if there is one
+    void Seek(uint64_t frame);
+
+private:
+    virtual int Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp) override;
+
+    static FLAC__StreamDecoderWriteStatus OnWrite(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame,
+        const FLAC__int32 *const buffer[], void *client);
+    static void OnMetadata(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client);
+    static void OnError(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client);
+    void Decode();
+
+    FLAC__StreamDecoder *m_decoder = nullptr;
+    unsigned int m_flacBits = 0;
+    unsigned int m_maxBlockSize = 0;
+    uint64_t m_totalFrames = 0;
+    size_t m_sampleSize = 0;
+    std::vector<char> m_packed;
+
+    // Decoded frames, written by m_thread and read by Produce()
+    std::unique_ptr<RingBuffer> m_ring;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_eof = false;
+    bool m_quit = false;
+    bool m_seekPending = false;
+    uint64_t m_seekTo = 0;
+    uint64_t m_position = 0; // in frames, of the next frame that Produce() returns
+};
+#endif
+
+// Checks the format fields that both wav readers support
+static int CheckWavFormat(const struct wav_header &header)
+{
+    if (header.audio_format != FORMAT_PCM) {
+        CONSOLE_PRINT("Not PCM format");
+        return -1;
+    }
+
+    if (header.num_channels > 2) {
+        CONSOLE_PRINT("Can't support %u channels", header.num_channels);
+        CONSOLE_PRINT("Mono and stereo are supported");
+        return -1;
+    }
+
+    return 0;
+}
+
 int WavFile::Open(const char *wavFileName)
 {
     m_fin.open(wavFileName, std::ifstream::binary);
@@ -111,40 +259,68 @@ int WavFile::Open(const char *wavFileName)
         return -1;
     }
 
-    if (!m_fin.read((char *)&m_header, sizeof(m_header))) {
+    if (!m_fin.read((char *)&m_header, 3 * sizeof(uint32_t))) {
         CONSOLE_PRINT("Unable to read riff/wave header");
         return -1;
     }
 
-    if ((m_header.riff_id != ID_RIFF) ||
+    if ((m_header.riff_id != ID_RIFF && m_header.riff_id != ID_RF64) ||
             (m_header.riff_fmt != ID_WAVE)) {
         CONSOLE_PRINT("Not a riff/wave header");
         return -1;
     }
 
-    if (m_header.audio_format != FORMAT_PCM) {
-        CONSOLE_PRINT("Not PCM format");
+    // Walk the chunks, skipping the ones other than "fmt " and "data"
+    bool hasFmt = false;
+    struct chunk_header chunk;
+    while (m_fin.read((char *)&chunk, sizeof(chunk))) {
+        if (chunk.id == ID_FMT) {
+            if (chunk.sz < 16 || !m_fin.read((char *)&m_header.audio_format, 16)) {
+                CONSOLE_PRINT("Unable to read fmt chunk");
+                return -1;
+            }
+            m_header.fmt_id = chunk.id;
+            m_header.fmt_sz = chunk.sz;
+            m_fin.seekg((chunk.sz - 16) + (chunk.sz & 1), std::ios::cur);
+            hasFmt = true;
+        } else if (chunk.id == ID_DATA) {
+            m_header.data_id = chunk.id;
+            m_header.data_sz = chunk.sz;
+            break;
+        } else {
+            m_fin.seekg(chunk.sz + (chunk.sz & 1), std::ios::cur);
+        }
+    }
+
+    if (!hasFmt) {
+        CONSOLE_PRINT("No fmt chunk");
         return -1;
     }
 
-    if (memcmp(&m_header.data_id, "data", 4) != 0) {
+    if (m_header.data_id != ID_DATA) {
         CONSOLE_PRINT("No data chunk");
         return -1;
     }
 
-    if (m_header.num_channels > 2) {
-        CONSOLE_PRINT("Can't support %u channels", m_header.num_channels);
-        CONSOLE_PRINT("Mono and stereo are supported");
+    if (CheckWavFormat(m_header) < 0)
         return -1;
-    }
 
     m_sampleSize = m_header.bits_per_sample / 8 * m_header.num_channels;
 
+    // Up to the data chunk's end, as chunks like LIST may follow it. Streaming
+    // writers leave the size at 0 or 0xFFFFFFFF, RF64 too, so those go to EOF.
+    m_dataOffset = m_fin.tellg();
     m_fin.seekg(0, std::ios::end);
     long cur = m_fin.tellg();
-    m_pcmBytes = cur - sizeof(struct wav_header);
+    m_pcmBytes = cur - m_dataOffset;
+    if (m_header.data_sz != 0 && m_header.data_sz != 0xFFFFFFFF && (long)m_header.data_sz < m_pcmBytes)
+        m_pcmBytes = m_header.data_sz;
+    if (m_pcmBytes <= 0) {
+        CONSOLE_PRINT("No audio in the data chunk");
+        return -1;
+    }
 
-    m_fin.seekg(sizeof(struct wav_header), std::ios::beg);
+    m_fin.seekg(m_dataOffset, std::ios::beg);
 
     return 0;
 }
@@ -153,12 +329,37 @@ void WavFile::SeekToBegin()
 {
     std::lock_guard<std::mutex> _l(m_mutex);
     m_fin.clear();
-    m_fin.seekg(sizeof(struct wav_header), std::ios::beg);
+    m_fin.seekg(m_dataOffset, std::ios::beg);
+}
+
+static bool IsFlac(const char *fileName)
+{
+    char magic[4] = { 0 };
+    std::ifstream fin(fileName, std::ifstream::binary);
+    fin.read(magic, sizeof(magic));
+    return memcmp(magic, "fLaC", 4) == 0;
+}
+
+// Returns the reader that fits fileName, or nullptr if it can't be read
+static AudioFile *NewAudioFile(const char *fileName, Player *player)
+{
+    struct stat st;
+    if (strcmp(fileName, "-") == 0 || (stat(fileName, &st) == 0 && !S_ISREG(st.st_mode)))
+        return new WavStream(player);
+    if (IsFlac(fileName)) {
+#ifdef KPLAY_HAVE_FLAC
+        return new FlacFile(player);
+#else
+        CONSOLE_PRINT("kplay was built without FLAC support");
+        return nullptr;
+#endif
+    }
+    return new WavFile(player);
 }
 
 class Player : public lark::Route::Callbacks {
 public:
-    Player() : m_wav(this) { }
+    Player() { }
     int Go(int argc, char *argv[]);
 
     void RefreshDisplay(int64_t progress) const
@@ -174,12 +375,38 @@ public:
             snprintf(prog, sizeof(prog), "%2lld.%02lld%%", s_progress / 100, s_progress % 100);
         }
 
+        // Peak/RMS in dBFS of what's played with -l, which meters after the
+        // limiter. Otherwise of the source, as RouteA takes it in.
+        char lvl[56] = "";
+        if (m_meter) {
+            auto dB = [](double v) { return v > 1e-5 ? 20.0 * std::log10(v) : -99.9; };
+            const char *at = m_post ? "" : "src ";
+            if (m_chNum == 2) {
+                snprintf(lvl, sizeof(lvl), "%sL %5.1f/%5.1f R %5.1f/%5.1f", at,
+                    dB(m_meter->Peak(0)), dB(m_meter->Rms(0)), dB(m_meter->Peak(1)), dB(m_meter->Rms(1)));
+            } else {
+                snprintf(lvl, sizeof(lvl), "%s%5.1f/%5.1f", at, dB(m_meter->Peak(0)), dB(m_meter->Rms(0)));
+            }
+        }
+
+        // Where we are in the whole file's waveform
+        char view[48] = "";
+        if (m_showOverview && !m_overview.Empty()) {
+            view[0] = '[';
+            m_overview.Render(view + 1, 40, s_progress / 10000.0);
+            strcat(view, "]");
+        }
+
+        char gr[16] = "";
+        if (m_limiter && m_limiter->GainReductionDb() < -0.05f)
+            snprintf(gr, sizeof(gr), "GR %.1fdB", m_limiter->GainReductionDb());
+
         if (m_chNum == 2) {
-            STATUS_PRINT("L-CH VOLUME: %-8g R-CH VOLUME: %-8g %-10s   PITCH: %-8g  TEMPO: %-8g    %-7s %s ",
-                m_volL * m_volMaster, m_volR * m_volMaster, m_mute ? "MUTED" : "", m_pitch, m_tempo, StateString(), prog);
+            STATUS_PRINT("L-CH VOLUME: %-8g R-CH VOLUME: %-8g %-10s   PITCH: %-8g  TEMPO: %-8g    %-7s %s%s %s %-12s",
+                m_volL * m_volMaster, m_volR * m_volMaster, m_mute ? "MUTED" : "", m_pitch, EffectiveTempo(), StateString(), prog, view, lvl, gr);
         } else {
-            STATUS_PRINT("MONO-CH VOLUME: %-8g                    %-10s   PITCH: %-8g  TEMPO: %-8g    %-7s %s ",
-                         m_volMaster, m_mute ? "MUTED" : "", m_pitch, m_tempo, StateString(), prog);
+            STATUS_PRINT("MONO-CH VOLUME: %-8g                    %-10s   PITCH: %-8g  TEMPO: %-8g    %-7s %s%s %s %-12s",
+                         m_volMaster, m_mute ? "MUTED" : "", m_pitch, EffectiveTempo(), StateString(), prog, view, lvl, gr);
         }
     }
 
@@ -188,6 +415,12 @@ private:
     virtual void OnStarted() override;
     virtual void OnStopped(lark::Route::StopReason reason) override;
 
+    // The gain that m_blkGain applies to the channel with the given balance volume
+    inline double ChannelGain(double vol) const
+    {
+        return vol * m_volMaster * m_normGain * (m_mute ? 0.0 : 1.0);
+    }
+
     inline const char *StateString() const
     {
         static const char *tbl[] = {
@@ -196,7 +429,75 @@ private:
         return tbl[m_state];
     }
 
-    WavFile m_wav;
+    std::unique_ptr<AudioFile> m_file;
+    Pipeline m_pipeline;
+    std::unique_ptr<PcmSource> m_pcmSource;
+    std::unique_ptr<Resampler> m_resampler;
+
+    unsigned int m_outRate = 0; // 0 means the wav file's sample rate
+    Resampler::Quality m_rsQuality = Resampler::HIGH;
+    enum Stretch { SOUNDTOUCH, PHASE_VOCODER, PASSTHROUGH };
+    Stretch m_stretch = Stretch::SOUNDTOUCH;
+    std::unique_ptr<PhaseVocoder> m_vocoder;
+    bool m_benchmark = false;
+    unsigned int m_jobs = 0;    // stretch the whole file up front on this many threads
+    std::vector<float> m_rendered;
+    std::unique_ptr<BufferSource> m_renderedSource;
+    const char *m_routeFile = nullptr;  // nullptr for DEFAULT_ROUTE
+    Stretch m_preStretch = Stretch::PASSTHROUGH;    // what -j stretches with ahead of playback
+
+    // Files are played one after another through the same route
+    std::vector<std::string> m_playlist;
+    size_t m_current = 0;
+    std::ifstream m_playlistIn;     // -P, read as more files are needed
+    unsigned int m_routeRate = 0;
+    bool Playlist() const
+    {
+        return m_playlist.size() > 1 || m_playlistIn.is_open();
+    }
+    bool ReadPlaylist();
+    int OpenFile(const char *fileName);
+    int NextFile();
+    void ReportFirstFrame();
+    std::atomic<bool> m_fadingOut { false };
+    bool m_traceStartup = false;
+    const char *m_traceFile = nullptr;
+    realtime::Settings m_realtime;
+    bool m_lockMemory = false;
+    bool m_arena = false;
+    std::chrono::steady_clock::time_point m_startedAt;
+    void ApplyPitch();
+    void ApplyTempo();
+    std::unique_ptr<Equalizer> m_eq;
+    std::vector<EqBand> m_eqBands;
+    const char *m_eqSpec = nullptr;
+    const char *m_eqFile = nullptr;
+    bool m_eqBypass = false;
+    std::unique_ptr<Limiter> m_limiter;
+    double m_ceilingDb = NAN;   // dBTP, no limiting while NAN
+    // Stages on RouteA's output, with -l only, and RouteB playing what comes
+    // out of them on an output device
+    std::unique_ptr<PostChain> m_post;
+    lark::Route *m_playback = nullptr;
+    struct PlaybackCallbacks : public lark::Route::Callbacks {
+        virtual void OnStarted() override { }
+        virtual void OnStopped(lark::Route::StopReason reason) override
+        {
+            (void)reason;
+        }
+    } m_playbackCallbacks;
+    std::unique_ptr<MeterStage> m_meter;
+
+    // Sinks for the audio that kplay writes itself
+    std::unique_ptr<FileSink> m_stdoutSink;
+    std::unique_ptr<FileSink> m_savingSink;
+    Requantizer::Dither m_dither = Requantizer::NONE;
+    // -D, stdout follows m_dither unless it's given
+    Requantizer::Dither m_stdoutDither = Requantizer::NONE;
+    bool m_hasStdoutDither = false;
+    FileSink::Container m_container = FileSink::WAV;
+    bool m_hasContainer = false;    // -c, otherwise stdout stays raw PCM
+    int m_fsync = FileSink::FSYNC_NONE;
 
     enum Mode { NORMAL, REPEAT, NONINTERACTIVE };
     Mode m_mode = Mode::NORMAL;
@@ -213,6 +514,38 @@ private:
     double m_volR = 1.0;
     double m_volMaster = 1.0;
 
+    // Loudness normalization, off while m_targetLufs is NAN
+    double m_targetLufs = NAN;
+    bool m_liveAnalysis = false;   // -A live
+    bool m_liveLoudness = false;   // for the file playing
+    double m_normGain = 1.0;
+    std::string m_loudnessCache;
+    std::unique_ptr<LoudnessStage> m_loudness;
+    void PrepareNormalization(const char *fileName);
+    void SaveLiveLoudness();
+    bool m_showOverview = false;
+    Overview m_overview;
+    void PrepareOverview(const char *fileName);
+    int ParseSilence(const char *str);
+    enum class Silence {
+        KEEP,
+        TRIM,       // leading and trailing
+        SKIP,       // and long gaps
+    } m_silenceMode = Silence::KEEP;
+    double m_silenceDb = -60.0;
+    double m_silenceSeconds = 2.0;
+    uint64_t m_trailingSilence = 0;
+    std::unique_ptr<SilenceStage> m_silence;
+    double m_skipTempo = 1.0;       // times m_tempo while quiet, 1 for no smart skip
+    double m_skipDb = -45.0;
+    bool m_quiet = false;
+    std::unique_ptr<ActivityDetector> m_activity;
+    int ParseSmartSkip(const char *str);
+    double EffectiveTempo() const
+    {
+        return m_quiet ? std::min(m_tempo * m_skipTempo, TEMPO_MAX) : m_tempo;
+    }
+
     bool m_mute = false;
 
     unsigned int m_chNum = 0;
@@ -221,7 +554,7 @@ private:
     State m_state = STOPPED;
 
     struct Message {
-        enum ID { ON_KEY, ON_STOPPED, ON_STARTED, EXIT };
+        enum ID { ON_KEY, ON_STOPPED, ON_STARTED, ON_ACTIVITY, EXIT };
         ID id;
         char key;
     };
@@ -245,32 +578,340 @@ int WavFile::Produce(void *data, lark::samples_t samples, bool blocking, int64_t
     std::lock_guard<std::mutex> _l(m_mutex);
 
     long cur = m_fin.tellg();
-    m_player->RefreshDisplay((int64_t)(cur - sizeof(struct wav_header)) * (int64_t)10000 / (int64_t)m_pcmBytes);
+    const long left = cur < 0 ? 0 : m_dataOffset + m_pcmBytes - cur;
+    ReportProgress((int64_t)(m_pcmBytes - left) * (int64_t)10000 / (int64_t)m_pcmBytes);
+
+    const size_t bytes = std::min<size_t>(requestBytes, left);
+    m_fin.read((char *)data, bytes);
+    const std::streamsize read = m_fin.gcount();
+    if (read <= 0) {
+        ReportProgress(10000);
+        return lark::E_EOF;
+    }
+    if ((size_t)read < requestBytes) {
+        // last frame
+        memset((char *)data + read, 0, requestBytes - read);
+    }
+    return samples;
+}
 
-    if (m_fin.read((char *)data, requestBytes))
-        return samples;
-    else {
-        std::streamsize read = m_fin.gcount();
-        if (read > 0) {
-            // last frame
-            memset((char *)data + read, 0,  requestBytes - read);
-            return samples;
-        } else {
-            m_player->RefreshDisplay(10000);
-            return lark::E_EOF;
+WavStream::~WavStream()
+{
+    if (m_fd > 0)
+        close(m_fd);
+}
+
+size_t WavStream::ReadFully(void *data, size_t bytes)
+{
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t ret = read(m_fd, (char *)data + done, bytes - done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        done += ret;
+    }
+    return done;
+}
+
+bool WavStream::Skip(size_t bytes)
+{
+    char buf[512];
+    while (bytes > 0) {
+        size_t n = std::min(bytes, sizeof(buf));
+        if (ReadFully(buf, n) != n)
+            return false;
+        bytes -= n;
+    }
+    return true;
+}
+
+int WavStream::Open(const char *wavFileName)
+{
+    m_fd = (strcmp(wavFileName, "-") == 0) ? 0 : open(wavFileName, O_RDONLY);
+    if (m_fd < 0) {
+        CONSOLE_PRINT("Unable to open %s", wavFileName);
+        return -1;
+    }
+
+    if (ReadFully(&m_header, 3 * sizeof(uint32_t)) != 3 * sizeof(uint32_t)) {
+        CONSOLE_PRINT("Unable to read riff/wave header");
+        return -1;
+    }
+
+    if ((m_header.riff_id != ID_RIFF && m_header.riff_id != ID_RF64) ||
+            (m_header.riff_fmt != ID_WAVE)) {
+        CONSOLE_PRINT("Not a riff/wave header");
+        return -1;
+    }
+
+    // Walk the chunks in stream order, up to the "data" chunk
+    bool hasFmt = false;
+    uint64_t ds64DataBytes = 0;
+    struct chunk_header chunk;
+    while (ReadFully(&chunk, sizeof(chunk)) == sizeof(chunk)) {
+        if (chunk.id == ID_FMT) {
+            if (chunk.sz < 16 || ReadFully(&m_header.audio_format, 16) != 16) {
+                CONSOLE_PRINT("Unable to read fmt chunk");
+                return -1;
+            }
+            m_header.fmt_id = chunk.id;
+            m_header.fmt_sz = chunk.sz;
+            if (!Skip((chunk.sz - 16) + (chunk.sz & 1)))
+                break;
+            hasFmt = true;
+        } else if (chunk.id == ID_DS64 && chunk.sz >= 16) {
+            uint64_t sizes[2];
+            if (ReadFully(sizes, sizeof(sizes)) != sizeof(sizes) || !Skip(chunk.sz - sizeof(sizes)))
+                break;
+            ds64DataBytes = sizes[1];
+        } else if (chunk.id == ID_DATA) {
+            m_header.data_id = chunk.id;
+            m_header.data_sz = chunk.sz;
+            break;
+        } else if (!Skip(chunk.sz + (chunk.sz & 1))) {
+            break;
+        }
+    }
+
+    if (!hasFmt) {
+        CONSOLE_PRINT("No fmt chunk");
+        return -1;
+    }
+
+    if (m_header.data_id != ID_DATA) {
+        CONSOLE_PRINT("No data chunk");
+        return -1;
+    }
+
+    if (CheckWavFormat(m_header) < 0)
+        return -1;
+
+    m_sampleSize = m_header.bits_per_sample / 8 * m_header.num_channels;
+
+    // Writers that stream don't know the size up front, and leave it 0 or 0xFFFFFFFF
+    if (m_header.data_sz == 0xFFFFFFFF)
+        m_pcmBytes = ds64DataBytes;
+    else
+        m_pcmBytes = m_header.data_sz;
+
+    return 0;
+}
+
+int WavStream::Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp)
+{
+    if (timestamp)
+        *timestamp = -1;
+
+    size_t requestBytes = m_sampleSize * samples;
+    if (m_pcmBytes) {
+        ReportProgress((int64_t)(m_readBytes * 10000 / m_pcmBytes));
+        requestBytes = (size_t)std::min<uint64_t>(requestBytes, m_pcmBytes - m_readBytes);
+    }
+
+    size_t read = ReadFully(data, requestBytes);
+    m_readBytes += read;
+    if (read == 0) {
+        ReportProgress(10000);
+        return lark::E_EOF;
+    }
+
+    // last frame
+    memset((char *)data + read, 0, m_sampleSize * samples - read);
+    return samples;
+}
+
+#ifdef KPLAY_HAVE_FLAC
+FlacFile::~FlacFile()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> _l(m_mutex);
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    if (m_decoder) {
+        FLAC__stream_decoder_finish(m_decoder);
+        FLAC__stream_decoder_delete(m_decoder);
+    }
+}
+
+int FlacFile::Open(const char *flacFileName)
+{
+    m_decoder = FLAC__stream_decoder_new();
+    if (!m_decoder) {
+        CONSOLE_PRINT("Failed to create FLAC decoder");
+        return -1;
+    }
+    if (FLAC__stream_decoder_init_file(m_decoder, flacFileName, OnWrite, OnMetadata, OnError, this)
+            != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+        CONSOLE_PRINT("Unable to open %s", flacFileName);
+        return -1;
+    }
+    if (!FLAC__stream_decoder_process_until_end_of_metadata(m_decoder) || m_header.sample_rate == 0) {
+        CONSOLE_PRINT("Unable to read FLAC stream info");
+        return -1;
+    }
+
+    if (m_header.num_channels > 2) {
+        CONSOLE_PRINT("Can't support %u channels", m_header.num_channels);
+        CONSOLE_PRINT("Mono and stereo are supported");
+        return -1;
+    }
+
+    // Produce the PCM container that the wav path expects: FLAC's
+    // odd sample sizes are left-justified into 16, 24 or 32 bits
+    m_header.audio_format = FORMAT_PCM;
+    m_header.bits_per_sample = m_flacBits <= 16 ? 16 : (m_flacBits <= 24 ? 24 : 32);
+    m_header.block_align = m_header.bits_per_sample / 8 * m_header.num_channels;
+    m_header.byte_rate = m_header.block_align * m_header.sample_rate;
+    m_sampleSize = m_header.block_align;
+
+    // Room for a second of audio, and always for a few of the largest blocks
+    m_ring.reset(new RingBuffer(std::max<size_t>(m_header.sample_rate, 4 * m_maxBlockSize) * m_sampleSize));
+    m_thread = std::thread(&FlacFile::Decode, this);
+    return 0;
+}
+
+void FlacFile::OnMetadata(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client)
+{
+    (void)decoder;
+    FlacFile *self = (FlacFile *)client;
+    if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO)
+        return;
+    const FLAC__StreamMetadata_StreamInfo &info = metadata->data.stream_info;
+    self->m_header.num_channels = info.channels;
+    self->m_header.sample_rate = info.sample_rate;
+    self->m_flacBits = info.bits_per_sample;
+    self->m_maxBlockSize = info.max_blocksize;
+    self->m_totalFrames = info.total_samples;
+}
+
+void FlacFile::OnError(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client)
+{
+    // libFLAC resyncs to the next frame by itself
+    (void)decoder;
+    (void)status;
+    (void)client;
+}
+
+FLAC__StreamDecoderWriteStatus FlacFile::OnWrite(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame,
+    const FLAC__int32 *const buffer[], void *client)
+{
+    (void)decoder;
+    FlacFile *self = (FlacFile *)client;
+    const unsigned int frames = frame->header.blocksize;
+    const unsigned int chNum = self->m_header.num_channels;
+    const unsigned int bytes = self->m_header.bits_per_sample / 8;
+    const unsigned int shift = self->m_header.bits_per_sample - self->m_flacBits;
+
+    self->m_packed.resize(frames * self->m_sampleSize);
+    uint8_t *p = (uint8_t *)self->m_packed.data();
+    for (unsigned int i = 0; i < frames; ++i) {
+        for (unsigned int c = 0; c < chNum; ++c) {
+            uint32_t v = (uint32_t)buffer[c][i] << shift;
+            for (unsigned int b = 0; b < bytes; ++b)
+                *p++ = (uint8_t)(v >> (8 * b));
+        }
+    }
+    // Decode() made sure that the largest block fits
+    self->m_ring->Write(self->m_packed.data(), self->m_packed.size());
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FlacFile::Decode()
+{
+    const size_t blockBytes = std::max(m_maxBlockSize, 4608u) * m_sampleSize;
+
+    std::unique_lock<std::mutex> lk(m_mutex);
+    while (!m_quit) {
+        if (m_seekPending) {
+            // Produce() waits meanwhile, so this thread owns both ends of the ring
+            m_ring->Release(m_ring->Readable());
+            lk.unlock();
+            if (!FLAC__stream_decoder_seek_absolute(m_decoder, m_seekTo) &&
+                    FLAC__stream_decoder_get_state(m_decoder) == FLAC__STREAM_DECODER_SEEK_ERROR)
+                FLAC__stream_decoder_flush(m_decoder);
+            lk.lock();
+            m_position = m_seekTo;
+            m_eof = false;
+            m_seekPending = false;
+            m_cond.notify_all();
+            continue;
+        }
+
+        if (m_eof || m_ring->Capacity() - m_ring->Readable() < blockBytes) {
+            m_cond.wait(lk);
+            continue;
         }
+
+        lk.unlock();
+        bool ok = FLAC__stream_decoder_process_single(m_decoder);
+        bool end = !ok || FLAC__stream_decoder_get_state(m_decoder) == FLAC__STREAM_DECODER_END_OF_STREAM;
+        lk.lock();
+        m_eof = end;
+        m_cond.notify_all();
+    }
+}
+
+void FlacFile::Seek(uint64_t frame)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_seekTo = frame;
+    m_seekPending = true;
+    m_cond.notify_all();
+}
+
+int FlacFile::Produce(void *data, lark::samples_t samples, bool blocking, int64_t *timestamp)
+{
+    if (timestamp)
+        *timestamp = -1;
+
+    const size_t requestBytes = m_sampleSize * samples;
+
+    // Take whatever is decoded as it comes, as the ring may hold less than a whole request
+    std::unique_lock<std::mutex> lk(m_mutex);
+    size_t read = 0;
+    while (read < requestBytes) {
+        m_cond.wait(lk, [&] { return !m_seekPending && (m_eof || m_ring->Readable() > 0); });
+        const size_t bytes = std::min(m_ring->Readable(), requestBytes - read);
+        if (bytes == 0)
+            break;  // eof
+        m_ring->Read((char *)data + read, bytes);
+        read += bytes;
+        m_position += bytes / m_sampleSize;
+        m_cond.notify_all();
+    }
+
+    if (m_totalFrames)
+        ReportProgress((int64_t)(m_position * 10000 / m_totalFrames));
+    if (read == 0) {
+        ReportProgress(10000);
+        return lark::E_EOF;
     }
+
+    // last frame
+    if (read < requestBytes)
+        memset((char *)data + read, 0, requestBytes - read);
+    return samples;
 }
+#endif
 
 void Player::MsgHdl()
 {
     lark::Parameters args;
+    trace::NameThread("MsgHdl");
 
     while (1) {
         this->RefreshDisplay(-1);
 
         Message msg;
         m_msgQ->Produce(&msg, 1, nullptr);
+        trace::Instant(msg.id == Message::ON_KEY ? "MsgHdl key" : "MsgHdl message",
+            msg.id == Message::ON_KEY ? (int64_t)msg.key : (int64_t)msg.id);
 
         if (msg.id == Message::ON_KEY) {
             switch (msg.key) {
@@ -283,13 +924,45 @@ void Player::MsgHdl()
                 break;
 
             case 'z':  // Seek to Begin
-                m_wav.SeekToBegin();
+                if (!m_file->Seekable())
+                    break;
+                m_file->SeekToBegin();
+                m_pipeline.Reset();
+                break;
+
+            case 'n':  // Next File
+                if (!Playlist())
+                    break;
+                if (m_state == PLAYING)
+                    m_route->Stop();
+                SaveLiveLoudness();
+                ReportFirstFrame();
+                if (NextFile() < 0) {
+                    // Nothing left to play, as at the end of a single file
+                    Message end[2];
+                    end[0].id = Message::ON_KEY;
+                    end[0].key = 'z';
+                    end[1].id = Message::ON_KEY;
+                    end[1].key = 'c';
+                    m_msgQ->Consume(end, (m_mode == Mode::NORMAL) ? 1 : 2, -1);
+                    break;
+                }
+                args.clear();
+                args.push_back("0");
+                args.push_back(std::to_string(ChannelGain(m_volL)));
+                if (m_chNum == 2) {
+                    args.push_back("1");
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
+                }
+                m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
+                m_route->Start();
                 break;
 
             case 'x':  // Play/Stop
                 if (m_state == STOPPED) {
                     m_route->Start();
                 } else if (m_state == PLAYING) {
+                    m_fadingOut = true;
                     args.clear();
                     m_route->SetParameter(m_blkFadeOut, BLKFADEOUT_PARAMID_TRIGGER_FADING, args);
                 }
@@ -299,50 +972,38 @@ void Player::MsgHdl()
                 if (m_pitch >= PITCH_MAX)
                     break;
                 m_pitch = std::min(m_pitch * 1.01, PITCH_MAX);
-                args.clear();
-                args.push_back(std::to_string(m_pitch));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
+                ApplyPitch();
                 break;
 
             case 'f':  // Pitch Low
                 if (m_pitch <= PITCH_MIN)
                     break;
                 m_pitch = std::max(m_pitch * 0.99, PITCH_MIN);
-                args.clear();
-                args.push_back(std::to_string(m_pitch));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
+                ApplyPitch();
                 break;
 
             case 'v':  // Pitch Reset
                 m_pitch = 1.0;
-                args.clear();
-                args.push_back(std::to_string(m_pitch));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
+                ApplyPitch();
                 break;
 
             case 't':  // Tempo Fast
                 if (m_tempo >= TEMPO_MAX)
                     break;
                 m_tempo = std::min(m_tempo * 1.01, TEMPO_MAX);
-                args.clear();
-                args.push_back(std::to_string(m_tempo));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
+                ApplyTempo();
                 break;
 
             case 'g':  // Tempo Slow
                 if (m_tempo <= TEMPO_MIN)
                     break;
                 m_tempo = std::max(m_tempo * 0.99, TEMPO_MIN);
-                args.clear();
-                args.push_back(std::to_string(m_tempo));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
+                ApplyTempo();
                 break;
 
             case 'b':  // Tempo Reset
                 m_tempo = 1.0;
-                args.clear();
-                args.push_back(std::to_string(m_tempo));
-                m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
+                ApplyTempo();
                 break;
 
             case 'e':  // Balance Right
@@ -352,7 +1013,7 @@ void Player::MsgHdl()
                     m_volR = std::min(m_volR + 0.01, 1.0);
                     args.clear();
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                     m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 } else { // m_volR == 1.0
                     if (m_volL == 0.0)
@@ -360,7 +1021,7 @@ void Player::MsgHdl()
                     m_volL = std::max(m_volL - 0.01, 0.0);
                     args.clear();
                     args.push_back("0");
-                    args.push_back(std::to_string(m_volL * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volL)));
                     m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 }
                 break;
@@ -372,7 +1033,7 @@ void Player::MsgHdl()
                     m_volL = std::min(m_volL + 0.01, 1.0);
                     args.clear();
                     args.push_back("0");
-                    args.push_back(std::to_string(m_volL * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volL)));
                     m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 } else { // m_volL == 1.0
                     if (m_volR == 0.0)
@@ -380,7 +1041,7 @@ void Player::MsgHdl()
                     m_volR = std::max(m_volR - 0.01, 0.0);
                     args.clear();
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                     m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 }
                 break;
@@ -393,10 +1054,10 @@ void Player::MsgHdl()
                 m_volL = m_volR = 1.0;
                 args.clear();
                 args.push_back("0");
-                args.push_back(std::to_string(m_volL * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                args.push_back(std::to_string(ChannelGain(m_volL)));
                 if (m_chNum == 2) {
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                 }
                 m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 break;
@@ -405,10 +1066,10 @@ void Player::MsgHdl()
                 m_mute = !m_mute;
                 args.clear();
                 args.push_back("0");
-                args.push_back(std::to_string(m_volL * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                args.push_back(std::to_string(ChannelGain(m_volL)));
                 if (m_chNum == 2) {
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster * (m_mute ? 0.0 : 1.0)));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                 }
                 m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 break;
@@ -420,14 +1081,31 @@ void Player::MsgHdl()
                 m_mute = (m_volMaster == 0.0);
                 args.clear();
                 args.push_back("0");
-                args.push_back(std::to_string(m_volL * m_volMaster));
+                args.push_back(std::to_string(ChannelGain(m_volL)));
                 if (m_chNum == 2) {
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                 }
                 m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 break;
 
+            case 'y':  // EQ On/Off
+                if (!m_eq)
+                    break;
+                m_eqBypass = !m_eqBypass;
+                m_eq->SetBypass(m_eqBypass);
+                break;
+
+            case 'u':  // EQ Reload
+                if (!m_eq || !m_eqFile)
+                    break;
+                if (Equalizer::Load(m_eqFile, m_eq->Rate(), &m_eqBands) < 0) {
+                    CONSOLE_PRINT("\nInvalid equalizer bands in %s, keeping the current ones", m_eqFile);
+                    break;
+                }
+                m_eq->SetBands(m_eqBands);
+                break;
+
             case 's':  // Volume Up
                 if (m_volMaster == 1.0)
                     break;
@@ -435,10 +1113,10 @@ void Player::MsgHdl()
                 m_mute = (m_volMaster == 0.0);
                 args.clear();
                 args.push_back("0");
-                args.push_back(std::to_string(m_volL * m_volMaster));
+                args.push_back(std::to_string(ChannelGain(m_volL)));
                 if (m_chNum == 2) {
                     args.push_back("1");
-                    args.push_back(std::to_string(m_volR * m_volMaster));
+                    args.push_back(std::to_string(ChannelGain(m_volR)));
                 }
                 m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
                 break;
@@ -449,39 +1127,781 @@ void Player::MsgHdl()
 
         } else if (msg.id == Message::ON_STOPPED) {
             m_state = STOPPED;
+            SaveLiveLoudness();
             this->RefreshDisplay(-1);
 
         } else if (msg.id == Message::ON_STARTED) {
             m_state = PLAYING;
             this->RefreshDisplay(-1);
 
+        } else if (msg.id == Message::ON_ACTIVITY) {
+            // Whatever the detector says now, in case several turns queued up
+            const bool quiet = m_activity && m_activity->Quiet();
+            if (quiet != m_quiet) {
+                m_quiet = quiet;
+                ApplyTempo();
+                this->RefreshDisplay(-1);
+            }
+
         } else if (msg.id == Message::EXIT) {
             break;
         }
     }
 }
 
-void Player::MessageHandler(Player *player)
+// Hands the pitch and tempo to whichever engine stretches
+void Player::ApplyPitch()
 {
-    player->MsgHdl();
+    if (m_vocoder) {
+        m_vocoder->SetPitch(m_pitch);
+    } else if (m_stretch == Stretch::SOUNDTOUCH) {
+        lark::Parameters args;
+        args.push_back(std::to_string(m_pitch));
+        m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
+    }
 }
 
-void Player::Usage() const
+void Player::ApplyTempo()
 {
-    CONSOLE_PRINT(
-        "kplay - A WAV File Player with Real-Time Sound Tuning | Version %s\n"
-        "\n"
-        "Copyright (C) 2022  Kui Wang\n"
-        "\n"
-        "Usage: kplay [-o OUTPUT] [-f SAVINGFILE] [-m MODE] [-s] [-v VOLUME] [-p PITCH] [-t TEMPO] [-h] WAVFILE\n"
-        "\n"
-        "Mandatory argument\n"
-        "WAVFILE                    The wav file to play\n"
-        "\n"
+    if (m_vocoder) {
+        m_vocoder->SetTempo(EffectiveTempo());
+    } else if (m_stretch == Stretch::SOUNDTOUCH) {
+        lark::Parameters args;
+        args.push_back(std::to_string(EffectiveTempo()));
+        m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
+    }
+}
+
+void AudioFile::ReportProgress(int64_t progress)
+{
+    if (m_player)
+        m_player->RefreshDisplay(progress);
+}
+
+// A file with nothing over the gates is cached as "silent", which unlike
+// "-inf" reads back
+static bool ReadLoudness(const std::string &path, double *lufs)
+{
+    std::ifstream fin(path);
+    std::string text;
+    if (!fin || !(fin >> text))
+        return false;
+    if (text == "silent") {
+        *lufs = -HUGE_VAL;
+        return true;
+    }
+    char *end;
+    *lufs = strtod(text.c_str(), &end);
+    return end != text.c_str() && *end == '\0' && std::isfinite(*lufs);
+}
+
+static void WriteLoudness(const std::string &path, double lufs)
+{
+    std::ofstream fout(path);
+    if (std::isinf(lufs))
+        fout << "silent" << std::endl;
+    else
+        fout << lufs << std::endl;
+}
+
+// Measures the integrated loudness of the whole file in one go
+static int MeasureLoudness(const char *fileName, double *lufs)
+{
+    std::unique_ptr<AudioFile> file(NewAudioFile(fileName, nullptr));
+    if (!file || file->Open(fileName) < 0)
+        return -1;
+    const struct wav_header &header = file->Header();
+    const lark::samples_t chunk = 8192;
+    file->SetBlocking(true);
+    PcmSource source(file.get(), header.bits_per_sample, header.num_channels, chunk);
+    LoudnessMeter meter(header.num_channels, header.sample_rate);
+    std::vector<float> buf(chunk * header.num_channels);
+    int ret;
+    while ((ret = source.Pull(buf.data(), chunk)) > 0)
+        meter.Add(buf.data(), ret);
+    *lufs = meter.Integrated();
+    return 0;
+}
+
+// Discards whatever a route outputs
+class NullSink : public lark::DataConsumer {
+private:
+    virtual int Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp) override
+    {
+        (void)data;
+        (void)blocking;
+        (void)timestamp;
+        return samples;
+    }
+};
+
+// Waits for a route to stop by itself
+class RouteWaiter : public lark::Route::Callbacks {
+public:
+    virtual void OnStarted() override { }
+    virtual void OnStopped(lark::Route::StopReason reason) override
+    {
+        (void)reason;
+        std::lock_guard<std::mutex> _l(m_mutex);
+        m_stopped = true;
+        m_cond.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_cond.wait(lk, [this] { return m_stopped; });
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stopped = false;
+};
+
+// Keeps whatever a route outputs in memory
+class BufferSink : public lark::DataConsumer {
+public:
+    BufferSink(unsigned int chNum, std::vector<float> *out) : m_chNum(chNum), m_out(out) { }
+
+private:
+    virtual int Consume(const void *data, lark::samples_t samples, bool blocking, int64_t timestamp) override
+    {
+        (void)blocking;
+        (void)timestamp;
+        const float *frames = (const float *)data;
+        m_out->insert(m_out->end(), frames, frames + samples * m_chNum);
+        return samples;
+    }
+
+    const unsigned int m_chNum;
+    std::vector<float> *m_out;
+};
+
+static double CpuSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double WallSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Pulls the source dry
+static void PullAll(Stage *source, unsigned int chNum, std::vector<float> *out)
+{
+    std::vector<float> buf(4096 * chNum);
+    int ret;
+    while ((ret = source->Pull(buf.data(), 4096)) > 0)
+        out->insert(out->end(), buf.begin(), buf.begin() + ret * chNum);
+}
+
+// Runs the source through libblksoundtouch in a route of its own as fast as it
+// goes. Several of these can run at once, each one with a route of its own.
+static int RunSoundTouch(Stage *source, unsigned int chNum, unsigned int rate, double pitch, double tempo,
+    lark::DataConsumer *sink)
+{
+    static std::mutex routesMutex;
+    static unsigned int routes = 0;
+    std::unique_lock<std::mutex> lock(routesMutex);
+    lark::Lark &lk = lark::Lark::Instance();
+    RouteWaiter waiter;
+    lark::Route *route = lk.NewRoute(("Stretch" + std::to_string(routes++)).c_str(), &waiter);
+    if (!route)
+        return -1;
+
+    Pipeline pipeline;
+    pipeline.SetTail(source, chNum);
+    pipeline.SetBlocking(true);
+    lark::Parameters args;
+    args.push_back(std::to_string((unsigned long)static_cast<lark::DataProducer *>(&pipeline)));
+    lark::Block *blkStreamIn = route->NewBlock("libblkstreamin" SUFFIX, true, false, args);
+    lark::Block *blkSoundTouch = route->NewBlock("libblksoundtouch" SUFFIX, false, false);
+    args.clear();
+    args.push_back(std::to_string((unsigned long)sink));
+    lark::Block *blkStreamOut = route->NewBlock("libblkstreamout" SUFFIX, false, true, args);
+
+    const lark::samples_t frameSizeInSamples = 20/*ms*/ * rate / 1000;
+    if (!blkStreamIn || !blkSoundTouch || !blkStreamOut ||
+        !route->NewLink(rate, lark::SampleFormat_FLOAT, chNum, frameSizeInSamples, blkStreamIn, 0, blkSoundTouch, 0) ||
+        !route->NewLink(rate, lark::SampleFormat_FLOAT, chNum, frameSizeInSamples, blkSoundTouch, 0, blkStreamOut, 0)) {
+        lk.DeleteRoute(route);
+        return -1;
+    }
+    args.clear();
+    args.push_back(std::to_string(pitch));
+    route->SetParameter(blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
+    args.clear();
+    args.push_back(std::to_string(tempo));
+    route->SetParameter(blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
+
+    if (route->Start() < 0) {
+        lk.DeleteRoute(route);
+        return -1;
+    }
+
+    // Only setting up and tearing down routes is serialized, they run side by side
+    lock.unlock();
+    waiter.Wait();
+    lock.lock();
+    lk.DeleteRoute(route);
+    return 0;
+}
+
+// An engine for StretchInParallel that makes a fresh stretcher per segment
+static StretchEngine MakeStretchEngine(bool vocoder, unsigned int chNum, unsigned int rate, double pitch, double tempo)
+{
+    if (vocoder) {
+        return [=](Stage *source, std::vector<float> *out) {
+            PhaseVocoder pv(source, chNum, rate);
+            pv.SetPitch(pitch);
+            pv.SetTempo(tempo);
+            PullAll(&pv, chNum, out);
+            return 0;
+        };
+    }
+    return [=](Stage *source, std::vector<float> *out) {
+        BufferSink sink(chNum, out);
+        return RunSoundTouch(source, chNum, rate, pitch, tempo, &sink);
+    };
+}
+
+// A parallel render is accepted when it's within these of the serial one.
+// Renders that restart an engine at every segment stay around 1 to 2 dB apart,
+// while one 100 ms out of step is 3 dB apart. An audible click at a seam is
+// well over 20 dB steeper than the audio around it.
+static const double PARALLEL_MAX_SPECTRAL_DISTANCE = 2.5;  // dB
+static const double PARALLEL_MAX_SEAM_STEP = 6.0;          // dB
+
+// Renders fileName through soundtouch and pv once on one thread and once in
+// segments on jobs threads, printing the wall time of each, how far apart the
+// two renders are and how steep the worst seam is. Fails if either is beyond
+// what's accepted.
+static int BenchmarkParallel(const char *fileName, double pitch, double tempo, unsigned int jobs)
+{
+    std::unique_ptr<AudioFile> file(NewAudioFile(fileName, nullptr));
+    if (!file || file->Open(fileName) < 0)
+        return -1;
+    if (!file->Seekable()) {
+        CONSOLE_PRINT("Streams can only be read once, not comparing parallel renders");
+        return 0;
+    }
+    const struct wav_header &header = file->Header();
+    const unsigned int chNum = header.num_channels;
+    file->SetBlocking(true);
+    PcmSource source(file.get(), header.bits_per_sample, chNum, 4096);
+    std::vector<float> in;
+    PullAll(&source, chNum, &in);
+
+    CONSOLE_PRINT("");
+    CONSOLE_PRINT("STRETCH        SERIAL s    %2u JOBS s    SPEEDUP    SPECTRAL DISTANCE dB    SEAM dB", jobs);
+    int ret = 0;
+    for (int engine = 1; engine < 3; ++engine) {
+        static const char *names[] = { "passthrough", "soundtouch", "pv" };
+        const StretchEngine stretch = MakeStretchEngine(engine == 2, chNum, header.sample_rate, pitch, tempo);
+        std::vector<float> serial, parallel;
+        std::vector<size_t> seams;
+        BufferSource whole(in.data(), in.size() / chNum, chNum);
+        double start = WallSeconds();
+        if (stretch(&whole, &serial) < 0) {
+            CONSOLE_PRINT("%-14s unavailable", names[engine]);
+            continue;
+        }
+        const double serialSeconds = WallSeconds() - start;
+        start = WallSeconds();
+        if (StretchInParallel(in, chNum, header.sample_rate, tempo, jobs, stretch, &parallel, &seams) < 0)
+            return -1;
+        const double parallelSeconds = WallSeconds() - start;
+        const double distance = SpectralDistance(serial, parallel, chNum);
+        const double seam = SeamDiscontinuity(parallel, seams, chNum, header.sample_rate);
+        const bool failed = distance > PARALLEL_MAX_SPECTRAL_DISTANCE || seam > PARALLEL_MAX_SEAM_STEP;
+        CONSOLE_PRINT("%-14s %8.2f    %9.2f    %7.2f    %20.2f    %7.1f%s", names[engine], serialSeconds, parallelSeconds,
+            serialSeconds / parallelSeconds, distance, seam, failed ? "    FAILED" : "");
+        if (failed)
+            ret = -1;
+    }
+    if (ret < 0) {
+        CONSOLE_PRINT("Parallel renders must stay within %.1f dB spectral distance and %.1f dB seam steps",
+            PARALLEL_MAX_SPECTRAL_DISTANCE, PARALLEL_MAX_SEAM_STEP);
+    }
+    return ret;
+}
+
+// Decodes fileName through every stretch engine as fast as possible and prints
+// the CPU time each one takes per second of audio, along with its latency.
+// passthrough is the decoding alone, to be subtracted from the others.
+// With jobs, segment-parallel renders are compared to serial ones as well.
+static int BenchmarkStretch(const char *fileName, double pitch, double tempo, unsigned int jobs)
+{
+    static const char *names[] = { "passthrough", "soundtouch", "pv" };
+    double audioSeconds = 0.0;
+
+    CONSOLE_PRINT("Benchmarking %s at pitch %g and tempo %g", fileName, pitch, tempo);
+    CONSOLE_PRINT("STRETCH        CPU ms per s of audio    LATENCY ms");
+    for (int engine = 0; engine < 3; ++engine) {
+        std::unique_ptr<AudioFile> file(NewAudioFile(fileName, nullptr));
+        if (!file || file->Open(fileName) < 0)
+            return -1;
+        if (!file->Seekable() && engine > 0) {
+            CONSOLE_PRINT("Streams can only be read once, stopping here");
+            break;
+        }
+        const struct wav_header &header = file->Header();
+        file->SetBlocking(true);
+        PcmSource source(file.get(), header.bits_per_sample, header.num_channels, 4096);
+        std::unique_ptr<PhaseVocoder> vocoder;
+        Stage *tail = &source;
+        double latency = 0.0;
+        if (engine == 2) {
+            vocoder.reset(new PhaseVocoder(&source, header.num_channels, header.sample_rate));
+            vocoder->SetPitch(pitch);
+            vocoder->SetTempo(tempo);
+            tail = vocoder.get();
+            latency = 1000.0 * vocoder->Latency() / header.sample_rate;
+        }
+
+        const double start = CpuSeconds();
+        if (engine == 1) {
+            NullSink sink;
+            if (RunSoundTouch(tail, header.num_channels, header.sample_rate, pitch, tempo, &sink) < 0) {
+                CONSOLE_PRINT("%-14s unavailable", names[engine]);
+                continue;
+            }
+        } else {
+            std::vector<float> buf(4096 * header.num_channels);
+            uint64_t frames = 0;
+            int ret;
+            while ((ret = tail->Pull(buf.data(), 4096)) > 0)
+                frames += ret;
+            if (engine == 0)
+                audioSeconds = (double)frames / header.sample_rate;
+        }
+        const double cpu = CpuSeconds() - start;
+        if (audioSeconds <= 0.0)
+            return -1;
+
+        if (engine == 1) {
+            CONSOLE_PRINT("%-14s %21.2f    %10s", names[engine], cpu * 1000.0 / audioSeconds, "-");
+        } else {
+            CONSOLE_PRINT("%-14s %21.2f    %10.1f", names[engine], cpu * 1000.0 / audioSeconds, latency);
+        }
+    }
+    return jobs ? BenchmarkParallel(fileName, pitch, tempo, jobs) : 0;
+}
+
+// Times every resampling quality from the file's rate to outRate, or between
+// 44.1 and 48 kHz when outRate is 0 or the file's own
+static int BenchmarkResampler(const char *fileName, unsigned int outRate)
+{
+    static const char *names[] = { "low", "medium", "high", "best" };
+
+    std::unique_ptr<AudioFile> probe(NewAudioFile(fileName, nullptr));
+    if (!probe || probe->Open(fileName) < 0)
+        return -1;
+    if (!probe->Seekable()) {
+        CONSOLE_PRINT("Streams can only be read once, not benchmarking resampling");
+        return 0;
+    }
+    const unsigned int inRate = probe->Header().sample_rate;
+    if (outRate == 0 || outRate == inRate)
+        outRate = inRate == 48000 ? 44100 : 48000;
+    probe.reset();
+
+    CONSOLE_PRINT("Resampling %u Hz to %u Hz", inRate, outRate);
+    CONSOLE_PRINT("QUALITY        CPU ms per s of audio");
+    for (int quality = Resampler::LOW; quality <= Resampler::BEST; ++quality) {
+        std::unique_ptr<AudioFile> file(NewAudioFile(fileName, nullptr));
+        if (!file || file->Open(fileName) < 0)
+            return -1;
+        const struct wav_header &header = file->Header();
+        file->SetBlocking(true);
+        PcmSource source(file.get(), header.bits_per_sample, header.num_channels, 4096);
+        Resampler resampler(&source, header.num_channels, inRate, outRate, (Resampler::Quality)quality);
+
+        const double start = CpuSeconds();
+        std::vector<float> buf(4096 * header.num_channels);
+        uint64_t frames = 0;
+        int ret;
+        while ((ret = resampler.Pull(buf.data(), 4096)) > 0)
+            frames += ret;
+        const double cpu = CpuSeconds() - start;
+        if (frames == 0)
+            return -1;
+        CONSOLE_PRINT("%-14s %21.2f", names[quality], cpu * 1000.0 / ((double)frames / outRate));
+    }
+    return 0;
+}
+
+void Player::PrepareNormalization(const char *fileName)
+{
+    const std::string key = cache::Key(fileName);
+    if (key == "") {
+        CONSOLE_PRINT("Warning: %s can't be measured ahead, loudness won't be normalized", fileName);
+        m_liveLoudness = false;
+        return;
+    }
+    m_loudnessCache = cache::Path(key, ".loudness");
+
+    double lufs;
+    if (!ReadLoudness(m_loudnessCache, &lufs)) {
+        if (m_liveLoudness) {
+            CONSOLE_PRINT("Measuring loudness during playback, normalization takes effect from the next run");
+            return;
+        }
+        CONSOLE_PRINT("Measuring loudness of %s ...", fileName);
+        if (MeasureLoudness(fileName, &lufs) < 0)
+            return;
+        WriteLoudness(m_loudnessCache, lufs);
+    }
+    m_liveLoudness = false;
+
+    if (std::isinf(lufs)) {
+        CONSOLE_PRINT("Loudness: silent, not normalized");
+        return;
+    }
+    m_normGain = std::pow(10.0, (m_targetLufs - lufs) / 20.0);
+    CONSOLE_PRINT("Loudness: %.1f LUFS, normalizing by %+.1f dB", lufs, m_targetLufs - lufs);
+}
+
+// Scans the whole file for its waveform, folding every channel together
+static int ScanOverview(const char *fileName, Overview *overview)
+{
+    std::unique_ptr<AudioFile> file(NewAudioFile(fileName, nullptr));
+    if (!file || file->Open(fileName) < 0)
+        return -1;
+    const struct wav_header &header = file->Header();
+    const lark::samples_t chunk = 8192;
+    file->SetBlocking(true);
+    PcmSource source(file.get(), header.bits_per_sample, header.num_channels, chunk);
+    std::vector<float> buf(chunk * header.num_channels);
+    int ret;
+    while ((ret = source.Pull(buf.data(), chunk)) > 0)
+        overview->Add(buf.data(), ret, header.num_channels);
+    overview->Finish();
+    return 0;
+}
+
+// Parses trim|skip[:DB[:SECONDS]]
+int Player::ParseSilence(const char *str)
+{
+    const char *colon = strchr(str, ':');
+    const std::string mode(str, colon ? colon - str : strlen(str));
+    if (mode == "trim")
+        m_silenceMode = Silence::TRIM;
+    else if (mode == "skip")
+        m_silenceMode = Silence::SKIP;
+    else
+        return -1;
+    if (!colon)
+        return 0;
+    char *end;
+    m_silenceDb = strtod(colon + 1, &end);
+    if (end == colon + 1 || m_silenceDb > 0.0 || m_silenceDb < -96.0)
+        return -1;
+    if (*end == '\0')
+        return 0;
+    if (*end != ':')
+        return -1;
+    const char *seconds = end + 1;
+    m_silenceSeconds = strtod(seconds, &end);
+    if (end == seconds || *end != '\0' || m_silenceSeconds < 0.0 || m_silenceSeconds > 3600.0)
+        return -1;
+    return 0;
+}
+
+// Parses SKIPTEMPO[:DB]
+int Player::ParseSmartSkip(const char *str)
+{
+    char *end;
+    m_skipTempo = strtod(str, &end);
+    if (end == str || m_skipTempo < 1.0 || m_skipTempo > TEMPO_MAX)
+        return -1;
+    if (*end == '\0')
+        return 0;
+    if (*end != ':')
+        return -1;
+    const char *db = end + 1;
+    m_skipDb = strtod(db, &end);
+    if (end == db || *end != '\0' || m_skipDb > 0.0 || m_skipDb < -96.0)
+        return -1;
+    return 0;
+}
+
+// Loads the file's waveform from the cache, scanning it the first time
+void Player::PrepareOverview(const char *fileName)
+{
+    m_overview.Clear();
+    const std::string key = cache::Key(fileName);
+    if (key == "")
+        return;     // a stream, which can only be played once
+    const std::string path = cache::Path(key, ".overview");
+    if (m_overview.Load(path) == 0)
+        return;
+    CONSOLE_PRINT("Scanning %s for its waveform ...", fileName);
+    if (ScanOverview(fileName, &m_overview) < 0) {
+        m_overview.Clear();
+        return;
+    }
+    m_overview.Save(path);
+}
+
+// Caches the live measurement once it covers the whole file
+void Player::SaveLiveLoudness()
+{
+    if (!m_loudness || !m_loudness->Complete())
+        return;
+    WriteLoudness(m_loudnessCache, m_loudness->Meter().Integrated());
+    m_loudness.reset();
+}
+
+// Reads the next file name from -P, skipping blank lines
+bool Player::ReadPlaylist()
+{
+    std::string line;
+    while (m_playlistIn.is_open() && std::getline(m_playlistIn, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        m_playlist.push_back(line);
+        return true;
+    }
+    m_playlistIn.close();
+    return false;
+}
+
+// Opens fileName and builds the in-process chain that feeds RouteA from it.
+// Nothing is replaced if fileName can't be opened, RouteA can't take its
+// format or the equalizer bands don't parse at its rate. Stretching it with
+// -j or locking the new chain can only fail after the old chain is gone,
+// which leaves the pipeline without a tail, reading EOF, until NextFile()
+// opens the next file.
+int Player::OpenFile(const char *fileName)
+{
+    std::unique_ptr<AudioFile> file(NewAudioFile(fileName, this));
+    if (!file)
+        return -1;
+    int ret = file->Open(fileName);
+    if (ret < 0)
+        return ret;
+    startup::Mark("file opened");
+    const struct wav_header &header = file->Header();
+    if (header.bits_per_sample != 16 && header.bits_per_sample != 24 && header.bits_per_sample != 32) {
+        CONSOLE_PRINT("%u-bit is not supported", header.bits_per_sample);
+        return -1;
+    }
+    if (m_routeRate && header.num_channels != m_chNum) {
+        CONSOLE_PRINT("%s has %u channels while RouteA was built for %u, skipping",
+            fileName, header.num_channels, m_chNum);
+        return -1;
+    }
+    const unsigned int rate = m_routeRate ? m_routeRate : m_outRate ? m_outRate : header.sample_rate;
+    std::vector<EqBand> eqBands;
+    if (m_eqSpec || m_eqFile) {
+        ret = m_eqFile ? Equalizer::Load(m_eqFile, rate, &eqBands) : Equalizer::Parse(m_eqSpec, rate, &eqBands);
+        if (ret < 0) {
+            CONSOLE_PRINT("Invalid equalizer bands in %s", m_eqFile ? m_eqFile : m_eqSpec);
+            return -1;
+        }
+    }
+
+    m_pipeline.SetTail(nullptr, header.num_channels);
+    if (m_post)
+        m_post->SetTail(nullptr);
+
+    // Tear the old chain down first, so its buffers all go back to the arena
+    m_meter.reset();
+    m_limiter.reset();
+    m_eq.reset();
+    m_vocoder.reset();
+    m_renderedSource.reset();
+    m_resampler.reset();
+    m_activity.reset();
+    m_loudness.reset();
+    m_silence.reset();
+    m_pcmSource.reset();
+    m_file = std::move(file);
+    m_chNum = header.num_channels;
+    m_routeRate = rate;
+
+    m_liveLoudness = m_liveAnalysis;
+    m_loudnessCache = "";
+    m_normGain = 1.0;
+    if (!std::isnan(m_targetLufs)) {
+        PrepareNormalization(fileName);
+        startup::Mark("loudness prepared");
+    }
+    if (m_showOverview || m_silenceMode != Silence::KEEP) {
+        PrepareOverview(fileName);
+        startup::Mark("waveform prepared");
+    }
+
+    // Build the in-process chain that feeds RouteA with float frames
+    m_file->SetBlocking(true);
+    m_pcmSource.reset(new PcmSource(m_file.get(), header.bits_per_sample, m_chNum,
+        std::max<lark::samples_t>(20/*ms*/ * header.sample_rate / 1000, 1024)));
+    Stage *tail = m_pcmSource.get();
+    m_trailingSilence = 0;
+    if (m_silenceMode != Silence::KEEP) {
+        m_silence.reset(new SilenceStage(tail, m_chNum, header.sample_rate, m_silenceDb,
+            (uint64_t)(m_silenceSeconds * header.sample_rate), m_silenceMode == Silence::SKIP));
+        if (!m_overview.Empty()) {
+            // Known ahead from the overview, which streams don't have
+            const uint64_t end = SilenceStage::LastSound(m_overview, m_silenceDb);
+            m_silence->SetEnd(end);
+            m_trailingSilence = m_overview.Frames() - end;
+        }
+        tail = m_silence.get();
+    }
+    m_loudness.reset();
+    if (m_liveLoudness && m_loudnessCache != "") {
+        m_loudness.reset(new LoudnessStage(tail, m_chNum, header.sample_rate));
+        tail = m_loudness.get();
+    }
+    if (m_skipTempo != 1.0) {
+        // Turns are handled on the message handler, as SoundTouch's tempo is a route parameter
+        m_activity.reset(new ActivityDetector(tail, m_chNum, header.sample_rate, m_skipDb, [this]() {
+            Message msg = {
+                .id = Message::ON_ACTIVITY
+            };
+            if (m_msgQ)
+                m_msgQ->Consume(&msg, 1, -1);
+        }));
+        tail = m_activity.get();
+    }
+    if (m_quiet) {
+        // The new file starts out active
+        m_quiet = false;
+        if (m_route)
+            ApplyTempo();
+    }
+    m_resampler.reset();
+    if (rate != header.sample_rate) {
+        m_resampler.reset(new Resampler(tail, m_chNum, header.sample_rate, rate, m_rsQuality));
+        tail = m_resampler.get();
+    }
+    if (m_preStretch != Stretch::PASSTHROUGH) {
+        CONSOLE_PRINT("Stretching %s on %u threads ...", fileName, m_jobs);
+        std::vector<float> in;
+        PullAll(tail, m_chNum, &in);
+        const StretchEngine engine = MakeStretchEngine(m_preStretch == Stretch::PHASE_VOCODER, m_chNum, rate,
+            m_pitch, m_tempo);
+        m_rendered.clear();
+        if (StretchInParallel(in, m_chNum, rate, m_tempo, m_jobs, engine, &m_rendered) < 0) {
+            CONSOLE_PRINT("Failed to stretch %s", fileName);
+            return -1;
+        }
+        m_renderedSource.reset(new BufferSource(m_rendered.data(), m_rendered.size() / m_chNum, m_chNum));
+        tail = m_renderedSource.get();
+    }
+    if (m_stretch == Stretch::PHASE_VOCODER) {
+        m_vocoder.reset(new PhaseVocoder(tail, m_chNum, rate));
+        tail = m_vocoder.get();
+    }
+    if (m_eqSpec || m_eqFile) {
+        m_eqBands.swap(eqBands);
+        m_eq.reset(new Equalizer(tail, m_chNum, rate));
+        m_eq->SetBands(m_eqBands);
+        tail = m_eq.get();
+    }
+    // The limiter runs on RouteA's output, after everything that can overshoot,
+    // and the meter after it then
+    if (!std::isnan(m_ceilingDb)) {
+        if (!m_post)
+            m_post.reset(new PostChain(m_chNum, 20/*ms*/ * rate / 1000));
+        m_limiter.reset(new Limiter(m_post->Head(), m_chNum, rate, m_ceilingDb));
+        Stage *postTail = m_limiter.get();
+        if (m_mode != Mode::NONINTERACTIVE) {
+            m_meter.reset(new MeterStage(postTail, m_chNum, rate));
+            postTail = m_meter.get();
+        }
+        m_post->SetTail(postTail);
+    } else if (m_mode != Mode::NONINTERACTIVE) {
+        m_meter.reset(new MeterStage(tail, m_chNum, rate));
+        tail = m_meter.get();
+    }
+    std::string error;
+    if (arena::Enabled() && arena::Lock(&error) < 0) {
+        CONSOLE_PRINT("Unable to lock the pipeline's buffers: %s", error.c_str());
+        return -1;
+    }
+    m_pipeline.SetTail(tail, m_chNum);
+    startup::Mark("pipeline built");
+    return 0;
+}
+
+// Moves on to the next file in the playlist, wrapping around in repeat mode,
+// and skipping the ones that can't be played. Returns -1 if none is left.
+int Player::NextFile()
+{
+    size_t failures = 0;
+    while (failures < m_playlist.size()) {
+        size_t next = m_current + 1;
+        if (next == m_playlist.size() && !ReadPlaylist()) {
+            if (m_mode != Mode::REPEAT)
+                return -1;
+            next = 0;
+        }
+        m_current = next;
+        m_pipeline.Arm();
+        CONSOLE_PRINT("\nPlaying %s", m_playlist[m_current].c_str());
+        if (OpenFile(m_playlist[m_current].c_str()) == 0)
+            return 0;
+        ++failures;
+    }
+    return -1;
+}
+
+void Player::ReportFirstFrame()
+{
+    const double ms = m_pipeline.FirstFrameMs();
+    if (ms >= 0.0 && m_current == 0) {
+        // Only the first file's counts, it's the one armed in Go
+        startup::MarkAt("first sample pulled by the route",
+            m_startedAt + std::chrono::microseconds((int64_t)(ms * 1000.0)));
+    }
+    if (ms >= 0.0)
+        CONSOLE_PRINT("\n%s: %.1f ms from start to first sample", m_playlist[m_current].c_str(), ms);
+}
+
+void Player::MessageHandler(Player *player)
+{
+    player->MsgHdl();
+}
+
+void Player::Usage() const
+{
+    CONSOLE_PRINT(
+        "kplay - A WAV File Player with Real-Time Sound Tuning | Version %s\n"
+        "\n"
+        "Copyright (C) 2022  Kui Wang\n"
+        "\n"
+        "Usage: kplay [-o OUTPUT] [-F FORMAT] [-f SAVINGFILE] [-c CONTAINER] [-d DITHER] [-D DITHER] [-S FSYNC] [-m MODE] [-s] [-v VOLUME] [-p PITCH] [-t TEMPO] [-r RATE [-q QUALITY]] [-L LUFS [-A ANALYSIS]] [-l CEILING] [-e BANDS | -E EQFILE] [-T STRETCH] [-j JOBS] [-G ROUTEFILE] [-P PLAYLIST] [-I] [-J TRACEFILE] [-R SCHED] [-a CPUS] [-M] [-b] [-W] [-Z SILENCE] [-X SKIP] [-B] [-h] WAVFILE...\n"
+        "\n"
+        "Mandatory argument\n"
+        "WAVFILE...                 The wav (or flac) files to play one after another through the same route,\n"
+        "                           or - to read a wav stream from stdin\n"
+        "\n"
         "Optional arguments\n"
         "-o OUTPUT                  One of portaudio|alsa|tinyalsa|stdout|null\n"
         "                           that audio will output to (default portaudio)\n"
+        "-F FORMAT                  One of auto|native|float that OUTPUT takes (default auto)\n"
+        "                               auto: float if OUTPUT accepts it natively, otherwise native\n"
+        "                               native: the sample format of WAVFILE\n"
+        "                               float: 32-bit float\n"
         "-f SAVINGFILE              The file that audio will be saved to while playback\n"
+        "-c CONTAINER               One of wav|raw|flac|opus that SAVINGFILE and stdout are written in\n"
+        "                           (default wav for SAVINGFILE and raw for stdout), flac and opus are for\n"
+        "                           SAVINGFILE only\n"
+        "-d DITHER                  One of none|tpdf|shaped applied when SAVINGFILE or stdout is\n"
+        "                           requantized to the wav file's format (default none)\n"
+        "-D DITHER                  One of none|tpdf|shaped applied to stdout instead of -d's,\n"
+        "                           e.g. shaped for SAVINGFILE and none for a pipe that requantizes again\n"
+        "-S FSYNC                   One of none|close|SECONDS that SAVINGFILE is fsync'ed\n"
+        "                           never, on close, or every SECONDS (default none)\n"
         "-m MODE                    One of normal|repeat|noninteractive (default normal)\n"
         "                               normal: stop playback when reach EOF\n"
         "                               repeat: re-start playback when reach EOF\n"
@@ -490,19 +1910,62 @@ void Player::Usage() const
         "-v VOLUME                  The initial volume (default 1.0)\n"
         "-p PITCH                   The initial pitch (default 1.0)\n"
         "-t TEMPO                   The initial tempo (default 1.0)\n"
+        "-r RATE                    Resample to RATE Hz before output (default the wav file's rate)\n"
+        "-q QUALITY                 One of low|medium|high|best for resampling (default high)\n"
+        "-L LUFS                    Normalize the integrated loudness to LUFS, e.g. -23 or -16\n"
+        "-A ANALYSIS                One of prepass|live that measures the loudness when it isn't cached\n"
+        "                               prepass: before playback, normalizing right away\n"
+        "                               live: during playback, normalizing from the next run\n"
+        "-l CEILING                 Limit the true peak to CEILING dBTP, e.g. -1, after PITCH/TEMPO, VOLUME and fades\n"
+        "-e BANDS                   Equalize with up to 16 bands, each one TYPE:FREQ[:GAIN[:Q]] separated by ','\n"
+        "                               TYPE: peak|lowshelf|highshelf|lowpass|highpass|notch\n"
+        "                               e.g. lowshelf:120:-3,peak:2500:2:1.4\n"
+        "-E EQFILE                  Equalize with the bands in EQFILE, one per line, reloaded with [u]\n"
+        "-T STRETCH                 One of soundtouch|pv|passthrough that changes PITCH and TEMPO (default soundtouch)\n"
+        "                               soundtouch: WSOLA, low latency\n"
+        "                               pv: phase vocoder, smoother on tonal music, pitch within 0.25 to 4\n"
+        "                                   and tempo within 0.125 to 8\n"
+        "                               passthrough: no PITCH and TEMPO changes\n"
+        "-j JOBS                    Stretch the whole file before playback in segments on JOBS threads,\n"
+        "                           for noninteractive renders, PITCH and TEMPO can't change then\n"
+        "-G ROUTEFILE               Build the route from the graph in ROUTEFILE instead of the built-in one,\n"
+        "                           which needs blocks named gain, stretch and fadeout\n"
+        "-P PLAYLIST                Play the files listed in PLAYLIST one per line after the WAVFILEs,\n"
+        "                           read as they're needed so it can be a pipe kplay stays resident on\n"
+        "-I                         Trace startup, printing how long each phase took up to the first sample on exit\n"
+        "-J TRACEFILE               Record pipeline pulls, file writes and control messages, the last 65536 per thread,\n"
+        "                           and write them to TRACEFILE as a Chrome trace on exit\n"
+        "-R SCHED                   Run the route's threads at real-time priority, SCHED is fifo:PRIORITY or rr:PRIORITY\n"
+        "-a CPUS                    Pin the route's threads to CPUS, like 2,3 or 2-3\n"
+        "-M                         Lock all of kplay's memory so the route never waits on a page fault\n"
+        "-b                         Keep the pipeline's buffers in one arena, pre-faulted and locked before playback,\n"
+        "                           and print its footprint and any page faults in steady state on exit\n"
+        "-W                         Show the whole file's waveform with where playback is, scanned once and cached\n"
+        "-Z SILENCE                 One of trim[:DB]|skip[:DB[:SECONDS]] that leaves out silence, peaks under DB dBFS (default -60)\n"
+        "                               trim: before the first sound and after the last\n"
+        "                               skip: and beyond SECONDS (default 2) into every gap\n"
+        "-X SKIP                    SKIPTEMPO[:DB]: Play passages under DB dBFS RMS (default -45) at SKIPTEMPO times TEMPO,\n"
+        "                           e.g. 2, back at TEMPO as soon as speech or music is 6 dB over DB\n"
+        "-B                         Benchmark every STRETCH on WAVFILE at PITCH and TEMPO, then exit,\n"
+        "                           comparing serial and parallel renders too with JOBS and failing if they differ audibly,\n"
+        "                           and every QUALITY resampling to RATE (default 44.1 or 48 kHz, whichever WAVFILE isn't)\n"
         "-h                         Display version and usage information", __version);
 }
 
 int Player::Go(int argc, char *argv[])
 {
+    m_startedAt = std::chrono::steady_clock::now();
+    m_pipeline.Arm();
     if (argc < 2) {
         Usage();
         return 0;
     }
 
     std::string savingFile;
+    const char *playlistFile = nullptr;
     Output output = PORTAUDIO;
-    for (int ch = -1; (ch = getopt(argc, argv, "o:f:m:sv:p:t:h")) != -1; ) {
+    OutputFormat outputFormat = AUTO;
+    for (int ch = -1; (ch = getopt(argc, argv, "o:F:f:c:d:D:S:m:sv:p:t:r:q:L:A:l:e:E:T:j:G:P:IJ:R:a:MbWZ:X:Bh")) != -1; ) {
         switch (ch) {
         case 'o':
             if (strcmp(optarg, "stdout") == 0) {
@@ -520,9 +1983,47 @@ int Player::Go(int argc, char *argv[])
                 return -1;
             }
             break;
+        case 'F':
+            if (strcmp(optarg, "auto") == 0) {
+                outputFormat = AUTO;
+            } else if (strcmp(optarg, "native") == 0) {
+                outputFormat = NATIVE;
+            } else if (strcmp(optarg, "float") == 0) {
+                outputFormat = FLOAT;
+            } else {
+                CONSOLE_PRINT("Invalid -F argument: %s", optarg);
+                return -1;
+            }
+            break;
         case 'f':
             savingFile = optarg;
             break;
+        case 'c':
+            if (FileSink::ParseContainer(optarg, &m_container) < 0) {
+                CONSOLE_PRINT("Invalid -c argument: %s", optarg);
+                return -1;
+            }
+            m_hasContainer = true;
+            break;
+        case 'd':
+            if (Requantizer::ParseDither(optarg, &m_dither) < 0) {
+                CONSOLE_PRINT("Invalid -d argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'D':
+            if (Requantizer::ParseDither(optarg, &m_stdoutDither) < 0) {
+                CONSOLE_PRINT("Invalid -D argument: %s", optarg);
+                return -1;
+            }
+            m_hasStdoutDither = true;
+            break;
+        case 'S':
+            if (FileSink::ParseFsync(optarg, &m_fsync) < 0) {
+                CONSOLE_PRINT("Invalid -S argument: %s", optarg);
+                return -1;
+            }
+            break;
         case 'm':
             if (strcmp(optarg, "normal") == 0) {
                 m_mode = Mode::NORMAL;
@@ -579,6 +2080,116 @@ int Player::Go(int argc, char *argv[])
                 m_tempo = TEMPO_MIN;
             }
             break;
+        case 'r':
+            m_outRate = atoi(optarg);
+            if (m_outRate < 8000 || m_outRate > 384000) {
+                CONSOLE_PRINT("Invalid -r argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'q':
+            if (Resampler::ParseQuality(optarg, &m_rsQuality) < 0) {
+                CONSOLE_PRINT("Invalid -q argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'L':
+            m_targetLufs = atof(optarg);
+            if (m_targetLufs >= 0.0 || m_targetLufs < -70.0) {
+                CONSOLE_PRINT("Invalid -L argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'A':
+            if (strcmp(optarg, "prepass") == 0) {
+                m_liveAnalysis = false;
+            } else if (strcmp(optarg, "live") == 0) {
+                m_liveAnalysis = true;
+            } else {
+                CONSOLE_PRINT("Invalid -A argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'l':
+            m_ceilingDb = atof(optarg);
+            if (m_ceilingDb > 0.0 || m_ceilingDb < -20.0) {
+                CONSOLE_PRINT("Invalid -l argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'e':
+            m_eqSpec = optarg;
+            break;
+        case 'E':
+            m_eqFile = optarg;
+            break;
+        case 'T':
+            if (strcmp(optarg, "soundtouch") == 0) {
+                m_stretch = Stretch::SOUNDTOUCH;
+            } else if (strcmp(optarg, "pv") == 0) {
+                m_stretch = Stretch::PHASE_VOCODER;
+            } else if (strcmp(optarg, "passthrough") == 0) {
+                m_stretch = Stretch::PASSTHROUGH;
+            } else {
+                CONSOLE_PRINT("Invalid -T argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'j':
+            m_jobs = atoi(optarg);
+            if (m_jobs < 1 || m_jobs > 256) {
+                CONSOLE_PRINT("Invalid -j argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'G':
+            m_routeFile = optarg;
+            break;
+        case 'P':
+            playlistFile = optarg;
+            break;
+        case 'I':
+            m_traceStartup = true;
+            break;
+        case 'J':
+            m_traceFile = optarg;
+            break;
+        case 'R':
+            if (realtime::ParseScheduling(optarg, &m_realtime) < 0) {
+                CONSOLE_PRINT("Invalid -R argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'a':
+            if (realtime::ParseCpus(optarg, &m_realtime) < 0) {
+                CONSOLE_PRINT("Invalid -a argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'M':
+            m_lockMemory = true;
+            break;
+        case 'b':
+            m_arena = true;
+            break;
+        case 'W':
+            m_showOverview = true;
+            break;
+        case 'Z':
+            if (ParseSilence(optarg) < 0) {
+                CONSOLE_PRINT("Invalid -Z argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'X':
+            if (ParseSmartSkip(optarg) < 0) {
+                CONSOLE_PRINT("Invalid -X argument: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'B':
+            m_benchmark = true;
+            break;
         case 'h':
             Usage();
             return 0;
@@ -587,16 +2198,103 @@ int Player::Go(int argc, char *argv[])
         }
     }
 
-    if (!argv[optind]) {
+    startup::Mark("options parsed");
+    if (m_traceFile)
+        trace::Enable(1 << 16);
+
+    // Refuse up front rather than play without what was asked for
+    std::string rtError;
+    if (realtime::Probe(m_realtime, &rtError) < 0) {
+        CONSOLE_PRINT("Unable to set up the route's threads: %s", rtError.c_str());
+        return -1;
+    }
+    realtime::SetAudioSettings(m_realtime);
+    if (m_lockMemory && realtime::LockMemory(&rtError) < 0) {
+        CONSOLE_PRINT("Unable to lock memory: %s", rtError.c_str());
+        return -1;
+    }
+    if (m_arena && arena::Enable(64 << 20, &rtError) < 0) {
+        CONSOLE_PRINT("Unable to set up the buffer arena: %s", rtError.c_str());
+        return -1;
+    }
+
+    for (int i = optind; i < argc; ++i)
+        m_playlist.push_back(argv[i]);
+    if (playlistFile) {
+        m_playlistIn.open(playlistFile);
+        if (!m_playlistIn) {
+            CONSOLE_PRINT("Unable to open %s", playlistFile);
+            return -1;
+        }
+    }
+    if (m_playlist.empty() && !playlistFile) {
         CONSOLE_PRINT("Missing WAVFILE");
         return -1;
     }
 
-    int ret = m_wav.Open(argv[optind]);
+    if (FileSink::IsCompressed(m_container)) {
+        if (!Encoder::Available(m_container == FileSink::FLAC ? Encoder::FLAC : Encoder::OPUS)) {
+            CONSOLE_PRINT("kplay was built without %s support", m_container == FileSink::FLAC ? "FLAC" : "Opus");
+            return -1;
+        }
+        if (output == STDOUT) {
+            CONSOLE_PRINT("'-c %s' can't be used with '-o stdout'", m_container == FileSink::FLAC ? "flac" : "opus");
+            return -1;
+        }
+    }
+
+    // Disable lark logging to either stdout or stderr
+    lark::Lark &lk = lark::Lark::Instance();
+    KLOG_DISABLE_OPTIONS(KLOGGING_TO_STDOUT | KLOGGING_TO_STDERR);
+
+    if (m_playlist.empty() && !ReadPlaylist()) {
+        CONSOLE_PRINT("Empty playlist %s", playlistFile);
+        return -1;
+    }
+    for (const std::string &name : m_playlist) {
+        if (name == "-" && Playlist()) {
+            CONSOLE_PRINT("- can only be played on its own");
+            return -1;
+        }
+    }
+
+    // -j stretches ahead in the pipeline, so the route only passes through
+    if (m_jobs && !m_benchmark && m_stretch != Stretch::PASSTHROUGH) {
+        if (m_mode != Mode::NONINTERACTIVE) {
+            CONSOLE_PRINT("Warning: -j is for noninteractive renders, stretching as it plays");
+        } else {
+            m_preStretch = m_stretch;
+            m_stretch = Stretch::PASSTHROUGH;
+        }
+    }
+    if (m_skipTempo != 1.0 && m_stretch == Stretch::PASSTHROUGH) {
+        CONSOLE_PRINT("Warning: -X needs TEMPO to change as it plays, which -T passthrough and -j don't, ignoring it");
+        m_skipTempo = 1.0;
+    }
+
+    const char *fileName = m_playlist[0].c_str();
+    int ret = OpenFile(fileName);
     if (ret < 0)
         return ret;
 
-    const struct wav_header &header = m_wav.Header();
+    if (!m_file->Seekable() && m_mode == Mode::REPEAT) {
+        CONSOLE_PRINT("Warning: %s can't be repeated, defaulting to normal mode", fileName);
+        m_mode = Mode::NORMAL;
+    }
+
+    // Keys come from the terminal when stdin carries the audio
+    int keyFd = 0;
+    if (strcmp(fileName, "-") == 0 && m_mode != Mode::NONINTERACTIVE) {
+        keyFd = open("/dev/tty", O_RDONLY);
+        if (keyFd < 0) {
+            CONSOLE_PRINT("Warning: No terminal for keys, defaulting to noninteractive mode");
+            m_mode = Mode::NONINTERACTIVE;
+            keyFd = 0;
+        }
+    }
+
+    // The route is built for the first file, the later ones are resampled to its rate
+    const struct wav_header &header = m_file->Header();
     lark::SampleFormat format = lark::SampleFormat::BYTE;
     switch (header.bits_per_sample) {
     case 32:
@@ -605,20 +2303,17 @@ int Player::Go(int argc, char *argv[])
     case 24:
         format = lark::SampleFormat_S24_3;
         break;
-    case 16:
+    default:
         format = lark::SampleFormat_S16;
         break;
-    default:
-        CONSOLE_PRINT("%u-bit is not supported", header.bits_per_sample);
-        return -1;
     }
-    m_chNum = header.num_channels;
-    const unsigned int rate = header.sample_rate;
+    const unsigned int rate = m_routeRate;
     const lark::samples_t frameSizeInSamples = 20/*ms*/ * rate / 1000;
 
-    // Disable lark logging to either stdout or stderr
-    lark::Lark &lk = lark::Lark::Instance();
-    KLOG_DISABLE_OPTIONS(KLOGGING_TO_STDOUT | KLOGGING_TO_STDERR);
+    if (m_benchmark) {
+        ret = BenchmarkStretch(fileName, m_pitch, m_tempo, m_jobs);
+        return ret < 0 ? ret : BenchmarkResampler(fileName, m_outRate);
+    }
 
     m_msgQ = lk.NewFIFO(0, sizeof(struct Message), 1024);
     if (!m_msgQ) {
@@ -626,263 +2321,237 @@ int Player::Go(int argc, char *argv[])
         return -1;
     }
 
-    // Create the playback route named RouteA
-    m_route = lk.NewRoute("RouteA", this);
-    if (!m_route) {
-        CONSOLE_PRINT("Failed to create route");
-        return -1;
-    }
-
-    // Create RouteA's blocks
-    const char *soFileName = "libblkstreamin" SUFFIX;
-    lark::Parameters args;
-    lark::DataProducer *producer = &m_wav;
+    // Describe RouteA, checking the whole graph before anything is created
+    std::set<std::string> flags;
+    std::map<std::string, std::string> vars;
+    flags.insert(m_chNum == 2 ? "stereo" : "mono");
+    lark::DataProducer *producer = &m_pipeline;
     producer->SetBlocking(true);
-    args.clear();
-    args.push_back(std::to_string((unsigned long)producer));
-    lark::Block *blkStreamIn = m_route->NewBlock(soFileName, true, false, args);
-    if (!blkStreamIn) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
-        return -1;
-    }
-
-    soFileName = "libblkfadein" SUFFIX;
-    lark::Block *blkFadeIn = m_route->NewBlock(soFileName, false, false);
-    if (!blkFadeIn) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
-        return -1;
-    }
-    args.clear();
-    args.push_back(std::to_string(0.5)); // 0.5s to fade in
-    m_route->SetParameter(blkFadeIn, BLKFADEIN_PARAMID_FADING_TIME, args);
-
-    soFileName = "libblkgain" SUFFIX;
-    m_blkGain = m_route->NewBlock(soFileName, false, false);
-    if (!m_blkGain) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
-        return -1;
-    }
-    args.clear();
-    args.push_back("0");
-    args.push_back(std::to_string(m_volL * m_volMaster * (m_mute ? 0.0 : 1.0)));
-    if (m_chNum == 2) {
-        args.push_back("1");
-        args.push_back(std::to_string(m_volR * m_volMaster * (m_mute ? 0.0 : 1.0)));
-    }
-    m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
-
-    lark::Block *blkDeinterleave = nullptr;
-    lark::Block *blkInterleave = nullptr;
-    if (m_chNum == 2) {
-        soFileName = "libblkdeinterleave" SUFFIX;
-        blkDeinterleave = m_route->NewBlock(soFileName, false, false);
-        if (!blkDeinterleave) {
-            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-            lk.DeleteRoute(m_route);
+    vars["producer"] = std::to_string((unsigned long)producer);
+    // The phase vocoder stretches in the pipeline, leaving the block nothing to do
+    vars["stretch"] = m_stretch == Stretch::SOUNDTOUCH ? "libblksoundtouch|libblkpassthrough" : "libblkpassthrough";
+    if (savingFile != "") {
+        if (m_container == FileSink::FLAC && header.bits_per_sample > Encoder::MaxBitsPerSample(Encoder::FLAC)) {
+            CONSOLE_PRINT("FLAC supports up to %u-bit, %s is %u-bit, save it as wav or opus instead",
+                Encoder::MaxBitsPerSample(Encoder::FLAC), fileName, header.bits_per_sample);
             return -1;
         }
-
-        soFileName = "libblkinterleave" SUFFIX;
-        blkInterleave = m_route->NewBlock(soFileName, false, false);
-        if (!blkInterleave) {
-            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-            lk.DeleteRoute(m_route);
+        m_savingSink.reset(new FileSink(m_chNum, header.bits_per_sample, rate, m_dither, m_container));
+        m_savingSink->SetFsync(m_fsync);
+        // Writing and encoding run on the sink's own thread. Disk stalls must not
+        // reach real-time outputs, while other outputs can simply wait for the disk.
+        m_savingSink->SetAsync(2.0/*s*/, output == PORTAUDIO || output == ALSA || output == TINYALSA);
+        if (m_savingSink->Open(savingFile.c_str()) < 0) {
+            CONSOLE_PRINT("Unable to open %s", savingFile.c_str());
             return -1;
         }
+        // The saving file is requantized by m_savingSink, so it's fed with float.
+        // With -l it's saved from the post chain, so that it's limited as well.
+        if (m_post) {
+            m_post->AddSink(m_savingSink.get());
+        } else {
+            flags.insert("save");
+            vars["savesink"] = std::to_string((unsigned long)static_cast<lark::DataConsumer *>(m_savingSink.get()));
+        }
     }
 
-    soFileName = "libblkformatadapter" SUFFIX;
-    lark::Block *blkFormatAdapter = m_route->NewBlock(soFileName, false, false);
-    if (!blkFormatAdapter) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
+    RouteGraph graph(SUFFIX);
+    std::string error;
+    const char *routeName = m_routeFile ? m_routeFile : "(built-in)";
+    ret = m_routeFile ? graph.Load(m_routeFile, flags, vars, &error) : graph.Parse(DEFAULT_ROUTE, flags, vars, &error);
+    if (ret < 0) {
+        CONSOLE_PRINT("Invalid route %s: %s", routeName, error.c_str());
         return -1;
     }
-
-    soFileName = "libblksoundtouch" SUFFIX;
-    m_blkSoundTouch = m_route->NewBlock(soFileName, false, false);
-    if (!m_blkSoundTouch) {
-        CONSOLE_PRINT("Warning: Failed to new a block from %s, PITCH/TEMPO tuning won't take effect", soFileName);
-        soFileName = "libblkpassthrough" SUFFIX;
-        m_blkSoundTouch = m_route->NewBlock(soFileName, false, false);
-        if (!m_blkSoundTouch) {
-            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
+    for (const char *name : { "gain", "stretch", "fadeout" }) {
+        if (!graph.Has(name)) {
+            CONSOLE_PRINT("Invalid route %s: kplay needs a block named %s", routeName, name);
             return -1;
         }
-    } else {
-        args.clear();
-        args.push_back(std::to_string(m_pitch));
-        m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_PITCH, args);
-        args.clear();
-        args.push_back(std::to_string(m_tempo));
-        m_route->SetParameter(m_blkSoundTouch, BLKSOUNDTOUCH_PARAMID_TEMPO, args);
     }
-
-    soFileName = "libblkformatadapter" SUFFIX;
-    lark::Block *blkFormatAdapter1 = m_route->NewBlock(soFileName, false, false);
-    if (!blkFormatAdapter1) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
-        return -1;
-    }
-
-    soFileName = "libblkfadeout" SUFFIX;
-    m_blkFadeOut = m_route->NewBlock(soFileName, false, false);
-    if (!m_blkFadeOut) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
+    if (graph.Uses("producer") != 1) {
+        CONSOLE_PRINT("Invalid route %s: $producer has to be used exactly once, it's the one file being played", routeName);
         return -1;
     }
-    args.clear();
-    args.push_back(std::to_string(0.2)); // 0.2s to fade out
-    m_route->SetParameter(m_blkFadeOut, BLKFADEOUT_PARAMID_FADING_TIME, args);
-
-    lark::Block *blkOutput = nullptr;
-    switch (output) {
-    case PORTAUDIO:
-        soFileName = "libblkpaplayback" SUFFIX;
-        blkOutput = m_route->NewBlock(soFileName, false, true);
-        break;
-    case ALSA:
-        soFileName = "libblkalsaplayback" SUFFIX;
-        blkOutput = m_route->NewBlock(soFileName, false, true);
-        break;
-    case TINYALSA:
-        soFileName = "libblktinyalsaplayback" SUFFIX;
-        blkOutput = m_route->NewBlock(soFileName, false, true);
-        break;
-    case STDOUT:
-        soFileName = "libblkfilewriter" SUFFIX;
-        args.clear();
-        args.push_back("--"); // stdout
-        blkOutput = m_route->NewBlock(soFileName, false, true, args);
-        break;
-    case NULLDEV:
-        soFileName = "libblkfilewriter" SUFFIX;
-        args.clear();
-        args.push_back("/dev/null");
-        blkOutput = m_route->NewBlock(soFileName, false, true, args);
-        break;
-    default:
-        lk.DeleteRoute(m_route);
+    if (graph.Uses("savesink") > 1) {
+        CONSOLE_PRINT("Invalid route %s: $savesink can be used once at most", routeName);
         return -1;
     }
-    if (!blkOutput) {
-        CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-        lk.DeleteRoute(m_route);
+    if (savingFile != "" && !m_post && !graph.Uses("savesink")) {
+        CONSOLE_PRINT("Route %s doesn't save, '-f %s' can't be used with it", routeName, savingFile.c_str());
         return -1;
     }
+    startup::Mark("route described");
 
-    // Create RouteA's links
-    if (!m_route->NewLink(rate, format, m_chNum, frameSizeInSamples, blkStreamIn, 0, blkFormatAdapter, 0)) {
-        CONSOLE_PRINT("Failed to new a link");
-        lk.DeleteRoute(m_route);
+    // Create the playback route named RouteA
+    m_route = lk.NewRoute("RouteA", this);
+    if (!m_route) {
+        CONSOLE_PRINT("Failed to create route");
         return -1;
     }
-    if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, blkFormatAdapter, 0, blkFadeIn, 0)) {
-        CONSOLE_PRINT("Failed to new a link");
+    startup::Mark("route created");
+    if (graph.Build(m_route, rate, m_chNum, frameSizeInSamples, format, &error) < 0) {
+        CONSOLE_PRINT("Failed to build RouteA: %s", error.c_str());
         lk.DeleteRoute(m_route);
         return -1;
     }
-    if (m_chNum == 2) { // stereo
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, blkFadeIn, 0, blkDeinterleave, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, blkDeinterleave, 0, m_blkGain, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, blkDeinterleave, 1, m_blkGain, 1)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, m_blkGain, 0, blkInterleave, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, m_blkGain, 1, blkInterleave, 1)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, blkInterleave, 0, m_blkSoundTouch, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-    } else { // mono
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, blkFadeIn, 0, m_blkGain, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
-        if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, 1, frameSizeInSamples, m_blkGain, 0, m_blkSoundTouch, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
-        }
+
+    lark::Parameters args;
+    lark::Block *blkFadeIn = graph.Block("fadein");
+    if (blkFadeIn) {
+        args.clear();
+        args.push_back(std::to_string(0.5)); // 0.5s to fade in
+        m_route->SetParameter(blkFadeIn, BLKFADEIN_PARAMID_FADING_TIME, args);
     }
-    if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, m_blkSoundTouch, 0, m_blkFadeOut, 0)) {
-        CONSOLE_PRINT("Failed to new a link");
-        lk.DeleteRoute(m_route);
-        return -1;
+
+    m_blkGain = graph.Block("gain");
+    args.clear();
+    args.push_back("0");
+    args.push_back(std::to_string(ChannelGain(m_volL)));
+    if (m_chNum == 2) {
+        args.push_back("1");
+        args.push_back(std::to_string(ChannelGain(m_volR)));
     }
-    if (!m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, m_blkFadeOut, 0, blkFormatAdapter1, 0)) {
-        CONSOLE_PRINT("Failed to new a link");
-        lk.DeleteRoute(m_route);
-        return -1;
+    m_route->SetParameter(m_blkGain, BLKGAIN_PARAMID_GAIN, args);
+
+    m_blkSoundTouch = graph.Block("stretch");
+    if (m_stretch == Stretch::SOUNDTOUCH && graph.Library("stretch") == "libblkpassthrough") {
+        CONSOLE_PRINT("Warning: Failed to new a block from %s, PITCH/TEMPO tuning won't take effect", "libblksoundtouch" SUFFIX);
+        m_stretch = Stretch::PASSTHROUGH;
     }
+    ApplyPitch();
+    ApplyTempo();
 
-    if (savingFile != "") {
-        soFileName = "libblkfilewriter" SUFFIX;
+    m_blkFadeOut = graph.Block("fadeout");
+    args.clear();
+    args.push_back(std::to_string(0.2)); // 0.2s to fade out
+    m_route->SetParameter(m_blkFadeOut, BLKFADEOUT_PARAMID_FADING_TIME, args);
+
+    // With -l, RouteA ends in the post chain, which writes stdout itself and
+    // hands what an output device plays on to RouteB
+    unsigned int outputPort;
+    lark::Block *blkOutputFeeder = graph.Output(&outputPort);
+    lark::Route *playback = m_route;
+    auto deleteRoutes = [&]() {
+        if (m_playback)
+            lk.DeleteRoute(m_playback);
+        lk.DeleteRoute(m_route);
+    };
+    const char *soFileName = nullptr;
+    if (m_post) {
+        soFileName = "libblkstreamout" SUFFIX;
         args.clear();
-        args.push_back(savingFile);
-        lark::Block *blkFileWriter = m_route->NewBlock(soFileName, false, true, args);
-        if (!blkFileWriter) {
-            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-            lk.DeleteRoute(m_route);
+        args.push_back(std::to_string((unsigned long)static_cast<lark::DataConsumer *>(m_post.get())));
+        lark::Block *blkPost = m_route->NewBlock(soFileName, false, true, args);
+        if (!blkPost || !m_route->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples,
+                blkOutputFeeder, outputPort, blkPost, 0)) {
+            CONSOLE_PRINT("Failed to feed the limiter from RouteA");
+            deleteRoutes();
             return -1;
         }
-
-        soFileName = "libblkduplicator" SUFFIX;
-        lark::Block *blkDuplicator = m_route->NewBlock(soFileName, false, false);
-        if (!blkDuplicator) {
-            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
-            lk.DeleteRoute(m_route);
-            return -1;
+        if (output != STDOUT && output != NULLDEV) {
+            // Two frames in flight between the routes
+            m_post->EnableQueue(2 * frameSizeInSamples);
+            m_playback = lk.NewRoute("RouteB", &m_playbackCallbacks);
+            if (!m_playback) {
+                CONSOLE_PRINT("Failed to create route");
+                deleteRoutes();
+                return -1;
+            }
+            soFileName = "libblkstreamin" SUFFIX;
+            args.clear();
+            args.push_back(std::to_string((unsigned long)static_cast<lark::DataProducer *>(m_post.get())));
+            blkOutputFeeder = m_playback->NewBlock(soFileName, true, false, args);
+            if (!blkOutputFeeder) {
+                CONSOLE_PRINT("Failed to new a block from %s", soFileName);
+                deleteRoutes();
+                return -1;
+            }
+            outputPort = 0;
+            playback = m_playback;
         }
+    }
 
-        if (!m_route->NewLink(rate, format, m_chNum, frameSizeInSamples, blkFormatAdapter1, 0, blkDuplicator, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
+    if (output == STDOUT) {
+        m_stdoutSink.reset(new FileSink(m_chNum, header.bits_per_sample, rate,
+            m_hasStdoutDither ? m_stdoutDither : m_dither, m_hasContainer ? m_container : FileSink::RAW));
+        m_stdoutSink->Open("--");
+    }
+    if (m_post && !m_playback) {
+        // Nothing left for a route to play
+        if (m_stdoutSink)
+            m_post->AddSink(m_stdoutSink.get());
+    } else {
+        // The output device comes from -o rather than the graph
+        lark::Block *blkOutput = nullptr;
+        switch (output) {
+        case PORTAUDIO:
+            soFileName = "libblkpaplayback" SUFFIX;
+            blkOutput = playback->NewBlock(soFileName, false, true);
+            break;
+        case ALSA:
+            soFileName = "libblkalsaplayback" SUFFIX;
+            blkOutput = playback->NewBlock(soFileName, false, true);
+            break;
+        case TINYALSA:
+            soFileName = "libblktinyalsaplayback" SUFFIX;
+            blkOutput = playback->NewBlock(soFileName, false, true);
+            break;
+        case STDOUT:
+            soFileName = "libblkstreamout" SUFFIX;
+            args.clear();
+            args.push_back(std::to_string((unsigned long)static_cast<lark::DataConsumer *>(m_stdoutSink.get())));
+            blkOutput = playback->NewBlock(soFileName, false, true, args);
+            break;
+        case NULLDEV:
+            soFileName = "libblkfilewriter" SUFFIX;
+            args.clear();
+            args.push_back("/dev/null");
+            blkOutput = playback->NewBlock(soFileName, false, true, args);
+            break;
+        default:
+            deleteRoutes();
             return -1;
         }
-        if (!m_route->NewLink(rate, format, m_chNum, frameSizeInSamples, blkDuplicator, 0, blkOutput, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
+        if (!blkOutput) {
+            CONSOLE_PRINT("Failed to new a block from %s", soFileName);
+            deleteRoutes();
             return -1;
         }
-        if (!m_route->NewLink(rate, format, m_chNum, frameSizeInSamples, blkDuplicator, 1, blkFileWriter, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
+        startup::Mark(std::string("block output from ") + soFileName);
+
+        // Negotiate the output format. When the output block takes float frames,
+        // they go straight from the graph's output to it without the trailing adapter.
+        bool floatOutput = (output == STDOUT) || (outputFormat == FLOAT) ||
+            (outputFormat == AUTO && (output == PORTAUDIO || output == NULLDEV));
+        if (floatOutput && !playback->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, blkOutputFeeder, outputPort, blkOutput, 0)) {
+            CONSOLE_PRINT("Warning: The output doesn't take float, falling back to %u-bit", header.bits_per_sample);
+            floatOutput = false;
         }
-    } else {
-        if (!m_route->NewLink(rate, format, m_chNum, frameSizeInSamples, blkFormatAdapter1, 0, blkOutput, 0)) {
-            CONSOLE_PRINT("Failed to new a link");
-            lk.DeleteRoute(m_route);
-            return -1;
+
+        if (!floatOutput) {
+            soFileName = "libblkformatadapter" SUFFIX;
+            lark::Block *blkFormatAdapter1 = playback->NewBlock(soFileName, false, false);
+            if (!blkFormatAdapter1) {
+                CONSOLE_PRINT("Failed to new a block from %s", soFileName);
+                deleteRoutes();
+                return -1;
+            }
+            if (!playback->NewLink(rate, lark::SampleFormat_FLOAT, m_chNum, frameSizeInSamples, blkOutputFeeder, outputPort, blkFormatAdapter1, 0)) {
+                CONSOLE_PRINT("Failed to new a link");
+                deleteRoutes();
+                return -1;
+            }
+            if (!playback->NewLink(rate, format, m_chNum, frameSizeInSamples, blkFormatAdapter1, 0, blkOutput, 0)) {
+                CONSOLE_PRINT("Failed to new a link");
+                deleteRoutes();
+                return -1;
+            }
         }
     }
 
+    startup::Mark("output linked");
+
     if (m_mode == Mode::NONINTERACTIVE) {
         CONSOLE_PRINT(
                 "*************************************************************************************************************\n"
@@ -896,39 +2565,57 @@ int Player::Go(int argc, char *argv[])
                 "*************************************************************************************************************\n"
                 "* [q] Balance Left   [w] Balance Mid  [e] Balance Right  [r] Pitch High   [t] Tempo Fast    |   K P L A Y   *\n"
                 "* [a] Volume Down    [s] Volume Up    [d] Mute/Unmute    [f] Pitch Low    [g] Tempo Slow    | P O W E R E D *\n"
-                "* [z] Seek to Begin  [x] Play/Stop    [c] Exit           [v] Pitch Reset  [b] Tempo Reset   | B Y   L A R K *\n"
-                "*************************************************************************************************************");
+                "* [z] Seek to Begin  [x] Play/Stop    [c] Exit           [v] Pitch Reset  [b] Tempo Reset   | B Y   L A R K *");
         } else {
             CONSOLE_PRINT(
                 "*************************************************************************************************************\n"
                 "*                                                        [r] Pitch High   [t] Tempo Fast    |   K P L A Y   *\n"
                 "* [a] Volume Down    [s] Volume Up    [d] Mute/Unmute    [f] Pitch Low    [g] Tempo Slow    | P O W E R E D *\n"
-                "* [z] Seek to Begin  [x] Play/Stop    [c] Exit           [v] Pitch Reset  [b] Tempo Reset   | B Y   L A R K *\n"
-                "*************************************************************************************************************");
+                "* [z] Seek to Begin  [x] Play/Stop    [c] Exit           [v] Pitch Reset  [b] Tempo Reset   | B Y   L A R K *");
+        }
+        if (Playlist()) {
+            CONSOLE_PRINT(
+                "* [n] Next File                                                                             |               *");
+        }
+        if (m_eq) {
+            CONSOLE_PRINT("%s", m_eqFile ?
+                "* [y] EQ On/Off      [u] EQ Reload                                                          |               *" :
+                "* [y] EQ On/Off                                                                             |               *");
         }
+        CONSOLE_PRINT("*************************************************************************************************************");
     }
 
+    trace::NameThread("main");
     std::thread t1(MessageHandler, this);
 
-    // Start
+    // Start, RouteB first so that it's playing by the time RouteA's frames come
+    if (m_playback && m_playback->Start() < 0) {
+        CONSOLE_PRINT("Failed to start RouteB");
+        deleteRoutes();
+        return -1;
+    }
     if (m_route->Start() < 0) {
         CONSOLE_PRINT("Failed to start route");
-        lk.DeleteRoute(m_route);
+        deleteRoutes();
         return -1;
     }
+    startup::Mark("route started");
+    allocguard::Arm();
 
     struct termios attr;
-    tcgetattr(0, &attr);
+    tcgetattr(keyFd, &attr);
     attr.c_lflag &= ~(ICANON | ECHO);
     attr.c_cc[VTIME] = 0;
     attr.c_cc[VMIN] = 1;
-    tcsetattr(0, TCSANOW, &attr);
+    tcsetattr(keyFd, TCSANOW, &attr);
 
     if (m_mode != Mode::NONINTERACTIVE) {
         while (1) {
-            int key = getchar();
+            unsigned char ch;
+            int key = (read(keyFd, &ch, 1) == 1) ? ch : -1;
             if (key < 0)
                 key = 'c';
+            trace::Instant("key read", key);
             Message msg = {
                 .id = Message::ON_KEY,
                 .key = (char)key
@@ -940,17 +2627,64 @@ int Player::Go(int argc, char *argv[])
     }
 
     t1.join();
+    allocguard::Disarm();
+    if (keyFd > 0)
+        close(keyFd);
 
+    if (m_playback) {
+        m_playback->Stop();
+        lk.DeleteRoute(m_playback);
+    }
     lk.DeleteRoute(m_route);
+    SaveLiveLoudness();
+    ReportFirstFrame();
+    if (unsigned int failures = realtime::AudioFailures(&rtError))
+        CONSOLE_PRINT("\n%u route thread(s) kept their scheduling: %s", failures, rtError.c_str());
+    if (arena::Enabled())
+        CONSOLE_PRINT("\nBuffer arena\n%s", arena::Report().c_str());
+    if (allocguard::Available())
+        CONSOLE_PRINT("\nAllocation guard: %s", allocguard::Report().c_str());
+    if (m_traceStartup)
+        CONSOLE_PRINT("\nStartup\n%s", startup::Report().c_str());
+    bool writeFailed = false;
+    if (m_savingSink) {
+        if (m_savingSink->Close() < 0) {
+            CONSOLE_PRINT("\nFailed to write %s: %s", savingFile.c_str(), strerror(m_savingSink->Error()));
+            writeFailed = true;
+        }
+        uint64_t frames;
+        double seconds;
+        if (m_savingSink->EncoderStats(&frames, &seconds) && seconds > 0.0)
+            CONSOLE_PRINT("\nEncoded %.1fs of audio in %.2fs (%.1fx real time)",
+                (double)frames / rate, seconds, (double)frames / rate / seconds);
+        if (m_savingSink->DroppedFrames())
+            CONSOLE_PRINT("\nWarning: %llu frames were dropped from %s, the disk couldn't keep up (peak buffer use %u%%)",
+                (unsigned long long)m_savingSink->DroppedFrames(), savingFile.c_str(), m_savingSink->RingPeakPercent());
+    }
+    if (m_stdoutSink && m_stdoutSink->Close() < 0) {
+        CONSOLE_PRINT("\nFailed to write stdout: %s", strerror(m_stdoutSink->Error()));
+        writeFailed = true;
+    }
+    if (m_silence && m_silence->Skipped() + m_trailingSilence > 0)
+        CONSOLE_PRINT("\nSilence: %.1fs left out", (double)(m_silence->Skipped() + m_trailingSilence) / m_file->Header().sample_rate);
+    if (m_limiter && m_limiter->LimitedFrames())
+        CONSOLE_PRINT("\nLimiter: %.1fs limited, at most by %.1f dB",
+            (double)m_limiter->LimitedFrames() / rate, -m_limiter->MaxGainReductionDb());
+
+    // Last, once the routes and the sinks' writer threads are gone and can't add events
+    if (m_traceFile && trace::Write(m_traceFile) < 0)
+        CONSOLE_PRINT("\nUnable to write %s", m_traceFile);
 
     CONSOLE_PRINT("");
 
-    return 0;
+    // Fails a CI run that let the route's threads allocate
+    return (writeFailed || allocguard::Count()) ? -1 : 0;
 }
 
 void Player::OnStarted()
 {
     // Triggered from user
+    trace::Instant("OnStarted", 0);
 
     Message msg = {
         .id = Message::ON_STARTED
@@ -960,11 +2694,18 @@ void Player::OnStarted()
 
 void Player::OnStopped(lark::Route::StopReason reason)
 {
+    trace::Instant("OnStopped", reason);
     Message msg[2];
     msg[0].id = Message::ON_STOPPED;
     m_msgQ->Consume(msg, 1, -1);
 
-    if (reason != lark::Route::USER_STOP) { // Triggered from lark route
+    // Stopping by [x] fades out to the end of the route as well, but stays on the file
+    const bool fadedOut = m_fadingOut.exchange(false);
+    if (reason != lark::Route::USER_STOP && Playlist() && !fadedOut) { // Triggered from lark route
+        msg[0].id = Message::ON_KEY;
+        msg[0].key = 'n'; // Next File
+        m_msgQ->Consume(msg, 1, -1);
+    } else if (reason != lark::Route::USER_STOP) {
         msg[0].id = Message::ON_KEY,
         msg[0].key = 'z'; // Seek to Begin
         msg[1].id = Message::ON_KEY,
@@ -975,6 +2716,7 @@ void Player::OnStopped(lark::Route::StopReason reason)
 
 int main(int argc, char *argv[])
 {
+    startup::Mark("main");
     Player player;
     return player.Go(argc, argv);
 }
@@ -0,0 +1,130 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the ActivityDetector's hold and hysteresis.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Activity.h"
+#include <cmath>
+
+static const unsigned int RATE = 48000;
+
+// Stereo frames of a square wave whose RMS is Level dBFS
+class Level : public Stage {
+public:
+    Level() : Stage(nullptr) { }
+
+    void Set(double db)
+    {
+        m_amplitude = (float)std::pow(10.0, db / 20.0);
+    }
+
+    virtual int Pull(float *out, lark::samples_t frames) override
+    {
+        for (lark::samples_t i = 0; i < frames; ++i, m_sign = -m_sign)
+            out[2 * i] = out[2 * i + 1] = m_sign * m_amplitude;
+        return frames;
+    }
+
+private:
+    float m_amplitude = 0.0f;
+    float m_sign = 1.0f;
+};
+
+class Fixture {
+public:
+    Fixture() : detector(&level, 2, RATE, -40.0, [this]() { ++changes; }) { }
+
+    // Plays ms milliseconds at db dBFS in 10 ms pulls
+    void Play(double db, unsigned int ms)
+    {
+        level.Set(db);
+        float out[2 * RATE / 100];
+        for (unsigned int t = 0; t < ms; t += 10)
+            detector.Pull(out, RATE / 100);
+    }
+
+    Level level;
+    unsigned int changes = 0;
+    ActivityDetector detector;
+};
+
+static void TestHold()
+{
+    Fixture f;
+    f.Play(-20.0, 1000);
+    CHECK(!f.detector.Quiet());
+
+    // Quiet only after 300 ms under the threshold
+    f.Play(-50.0, 280);
+    CHECK(!f.detector.Quiet());
+    f.Play(-50.0, 40);
+    CHECK(f.detector.Quiet());
+    CHECK(f.changes == 1);
+
+    // Pauses within speech don't turn it
+    Fixture speech;
+    for (int i = 0; i < 20; ++i) {
+        speech.Play(-20.0, 200);
+        speech.Play(-50.0, 200);
+    }
+    CHECK(!speech.detector.Quiet());
+    CHECK(speech.changes == 0);
+}
+
+static void TestHysteresis()
+{
+    Fixture f;
+    f.Play(-50.0, 400);
+    CHECK(f.detector.Quiet());
+
+    // Between the threshold and 6 dB over it stays quiet
+    f.Play(-37.0, 1000);
+    CHECK(f.detector.Quiet());
+    CHECK(f.changes == 1);
+
+    // Active again within a block once over
+    f.Play(-30.0, 20);
+    CHECK(!f.detector.Quiet());
+    CHECK(f.changes == 2);
+
+    // And between the two, it stays active as well
+    f.Play(-37.0, 1000);
+    CHECK(!f.detector.Quiet());
+}
+
+static void TestReset()
+{
+    Fixture f;
+    f.Play(-60.0, 400);
+    CHECK(f.detector.Quiet());
+    f.detector.Reset();
+    CHECK(!f.detector.Quiet());
+    CHECK(f.changes == 2);
+    f.detector.Reset();
+    CHECK(f.changes == 2);
+}
+
+int main()
+{
+    TestHold();
+    TestHysteresis();
+    TestReset();
+    return s_failures;
+}
@@ -0,0 +1,111 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the Equalizer's band parsing and response.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Equalizer.h"
+#include <cmath>
+#include <string>
+
+static void TestParse()
+{
+    std::vector<EqBand> bands;
+    CHECK(Equalizer::Parse("lowshelf:120:-3,peak:2500:2:1.4", 48000, &bands) == 0);
+    CHECK(bands.size() == 2);
+    CHECK(bands[0].type == EqBand::LOWSHELF && bands[0].freq == 120.0 && bands[0].gainDb == -3.0);
+    CHECK(std::fabs(bands[0].q - M_SQRT1_2) < 1e-12);
+    CHECK(bands[1].type == EqBand::PEAK && bands[1].freq == 2500.0 && bands[1].gainDb == 2.0 && bands[1].q == 1.4);
+
+    // New lines separate bands too, comments and blank lines are skipped
+    CHECK(Equalizer::Parse("# a file\n\nhighpass:30\n  notch:50:0:10\n", 48000, &bands) == 0);
+    CHECK(bands.size() == 2);
+    CHECK(bands[0].type == EqBand::HIGHPASS && bands[0].gainDb == 0.0);
+    CHECK(bands[1].type == EqBand::NOTCH && bands[1].q == 10.0);
+
+    CHECK(Equalizer::Parse("", 48000, &bands) == 0 && bands.empty());
+}
+
+static void TestErrors()
+{
+    std::vector<EqBand> bands;
+    CHECK(Equalizer::Parse("bell:1000:3", 48000, &bands) < 0);
+    CHECK(Equalizer::Parse("peak", 48000, &bands) < 0);
+    CHECK(Equalizer::Parse("peak:0:3", 48000, &bands) < 0);
+    CHECK(Equalizer::Parse("peak:24000:3", 48000, &bands) < 0);      // at Nyquist
+    CHECK(Equalizer::Parse("peak:1000:31", 48000, &bands) < 0);
+    CHECK(Equalizer::Parse("peak:1000:3:0", 48000, &bands) < 0);
+
+    std::string many;
+    for (unsigned int i = 0; i <= Equalizer::MAX_BANDS; ++i)
+        many += "peak:1000:1,";
+    CHECK(Equalizer::Parse(many.c_str(), 48000, &bands) < 0);
+}
+
+// A sine of freq Hz, stereo
+class Sine : public Stage {
+public:
+    explicit Sine(double freq) : Stage(nullptr), m_step(2.0 * M_PI * freq / 48000) { }
+
+    virtual int Pull(float *out, lark::samples_t frames) override
+    {
+        for (lark::samples_t i = 0; i < frames; ++i, m_phase += m_step)
+            out[2 * i] = out[2 * i + 1] = (float)(0.25 * std::sin(m_phase));
+        return frames;
+    }
+
+private:
+    const double m_step;
+    double m_phase = 0.0;
+};
+
+// The gain in dB that spec applies at freq Hz, once settled
+static double GainAt(const char *spec, double freq)
+{
+    std::vector<EqBand> bands;
+    if (Equalizer::Parse(spec, 48000, &bands) < 0)
+        return NAN;
+    Sine sine(freq);
+    Equalizer eq(&sine, 2, 48000);
+    eq.SetBands(bands);
+    std::vector<float> out(2 * 4800);
+    for (int i = 0; i < 10; ++i)
+        eq.Pull(out.data(), 4800);
+    float peak = 0.0f;
+    for (float v : out)
+        peak = std::max(peak, std::fabs(v));
+    return 20.0 * std::log10(peak / 0.25);
+}
+
+static void TestResponse()
+{
+    CHECK(std::fabs(GainAt("peak:1000:6:1", 1000) - 6.0) < 0.1);
+    CHECK(std::fabs(GainAt("peak:1000:6:1", 10000)) < 0.5);
+    CHECK(std::fabs(GainAt("lowshelf:200:-6", 40) + 6.0) < 0.3);
+    CHECK(GainAt("highpass:100", 25) < -20.0);
+    CHECK(std::fabs(GainAt("peak:1000:6,peak:1000:-6", 1000)) < 0.1);
+}
+
+int main()
+{
+    TestParse();
+    TestErrors();
+    TestResponse();
+    return s_failures;
+}
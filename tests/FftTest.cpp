@@ -0,0 +1,104 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the Fft and the phase vocoder's latency.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Fft.h"
+#include "PhaseVocoder.h"
+#include <cmath>
+#include <cstdlib>
+
+// Inverse(Forward(x)) gives x back at every size the stages use
+static void TestRoundTrip()
+{
+    srand(1);
+    for (unsigned int n = 8; n <= 8192; n *= 2) {
+        Fft fft(n);
+        CHECK(fft.Size() == n);
+        std::vector<float> x(n), y(n);
+        std::vector<std::complex<float>> X(n / 2 + 1);
+        for (float &v : x)
+            v = rand() / (float)RAND_MAX - 0.5f;
+        fft.Forward(x.data(), X.data());
+        fft.Inverse(X.data(), y.data());
+        double worst = 0.0;
+        for (unsigned int i = 0; i < n; ++i)
+            worst = std::max(worst, (double)std::fabs(x[i] - y[i]));
+        CHECK(worst < 1e-5);
+    }
+}
+
+// A cosine on bin k only shows up in bin k, with n / 2 times its amplitude
+static void TestBins()
+{
+    const unsigned int n = 1024;
+    Fft fft(n);
+    std::vector<float> x(n);
+    std::vector<std::complex<float>> X(n / 2 + 1);
+    for (unsigned int k : { 0u, 1u, 37u, n / 2 }) {
+        for (unsigned int i = 0; i < n; ++i)
+            x[i] = (float)std::cos(2.0 * M_PI * k * i / n);
+        fft.Forward(x.data(), X.data());
+        const double expected = (k == 0 || k == n / 2) ? n : n / 2;
+        for (unsigned int b = 0; b <= n / 2; ++b)
+            CHECK(std::fabs(std::abs(X[b]) - (b == k ? expected : 0.0)) < 1e-2);
+    }
+}
+
+// Silence, then a sine from frame ONSET on
+class Onset : public Stage {
+public:
+    enum { ONSET = 20000 };
+
+    Onset() : Stage(nullptr) { }
+
+    virtual int Pull(float *out, lark::samples_t frames) override
+    {
+        for (lark::samples_t i = 0; i < frames; ++i, ++m_pos)
+            out[i] = m_pos >= ONSET ? (float)std::sin(0.1 * m_pos) : 0.0f;
+        return frames;
+    }
+
+private:
+    unsigned int m_pos = 0;
+};
+
+// At tempo and pitch 1, what goes in comes out Latency() frames later
+static void TestVocoderLatency()
+{
+    Onset onset;
+    PhaseVocoder pv(&onset, 1, 48000);
+    std::vector<float> out(Onset::ONSET + 2 * pv.Latency());
+    for (size_t done = 0; done < out.size(); )
+        done += pv.Pull(out.data() + done, std::min<size_t>(480, out.size() - done));
+    size_t first = 0;
+    while (first < out.size() && std::fabs(out[first]) < 0.5f)
+        ++first;
+    CHECK(first >= Onset::ONSET);
+    CHECK(std::labs((long)(first - Onset::ONSET) - (long)pv.Latency()) < 64);
+}
+
+int main()
+{
+    TestRoundTrip();
+    TestBins();
+    TestVocoderLatency();
+    return s_failures;
+}
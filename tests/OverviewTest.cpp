@@ -0,0 +1,136 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the Overview's coding, caching and rendering.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Overview.h"
+#include <cmath>
+#include <cstring>
+
+static const char *FILE_NAME = "OverviewTest.bin";
+
+// Codes are rounded outwards, never under the level they stand for
+static void TestEncode()
+{
+    CHECK(Overview::Encode(0.0f) == 0);
+    CHECK(Overview::Encode(1.0f) == 127);
+    CHECK(Overview::Encode(-1.0f) == -127);
+    CHECK(Overview::Encode(2.0f) == 127);
+    CHECK(Overview::Encode(1e-6f) == 0);               // under -96 dBFS
+    CHECK(Overview::Decibels(0) == -HUGE_VAL);
+    CHECK(Overview::Decibels(127) == 0.0);
+    for (float v = 1.0f; v > 2e-5f; v *= 0.9f) {
+        const double db = 20.0 * std::log10(v);
+        const double coded = Overview::Decibels(Overview::Encode(v));
+        CHECK(coded >= db - 1e-9 && coded < db + 96.0 / 126 + 1e-9);
+        CHECK(Overview::Encode(-v) == -Overview::Encode(v));
+    }
+}
+
+// A ramp from silence to full scale over 100 bins, in stereo
+static void Fill(Overview *overview)
+{
+    const unsigned int bins = 100;
+    std::vector<float> frames(2 * Overview::BIN_FRAMES);
+    for (unsigned int b = 0; b < bins; ++b) {
+        const float level = (float)b / (bins - 1);
+        for (unsigned int i = 0; i < Overview::BIN_FRAMES; ++i) {
+            frames[2 * i] = (i & 1) ? level : -level;
+            frames[2 * i + 1] = level / 2;
+        }
+        // Split unevenly, bins don't depend on how frames come in
+        overview->Add(frames.data(), 1000, 2);
+        overview->Add(frames.data() + 2000, Overview::BIN_FRAMES - 1000, 2);
+    }
+    overview->Add(frames.data(), 10, 2);
+    overview->Finish();
+}
+
+static void TestLevels()
+{
+    Overview overview;
+    CHECK(overview.Empty());
+    Fill(&overview);
+    CHECK(!overview.Empty());
+    CHECK(overview.Frames() == 100 * Overview::BIN_FRAMES + 10);
+    CHECK(overview.Level(0).size() == 101);
+    CHECK(overview.Level(0)[0].min == 0 && overview.Level(0)[0].max == 0);
+    CHECK(overview.Level(0)[99].min == -127 && overview.Level(0)[99].max == 127);
+    CHECK(overview.Level(overview.Levels() - 1).size() == 1);
+    for (size_t l = 1; l < overview.Levels(); ++l)
+        CHECK(overview.Level(l).size() == (overview.Level(l - 1).size() + 1) / 2);
+    CHECK(overview.Level(overview.Levels() - 1)[0].max == 127);
+}
+
+static void TestSaveLoad()
+{
+    Overview saved, loaded;
+    CHECK(saved.Save(FILE_NAME) < 0);                   // nothing to save
+    Fill(&saved);
+    CHECK(saved.Save(FILE_NAME) == 0);
+    CHECK(loaded.Load(FILE_NAME) == 0);
+    CHECK(loaded.Frames() == saved.Frames());
+    CHECK(loaded.Levels() == saved.Levels());
+    for (size_t l = 0; l < saved.Levels() && l < loaded.Levels(); ++l) {
+        CHECK(loaded.Level(l).size() == saved.Level(l).size());
+        CHECK(memcmp(loaded.Level(l).data(), saved.Level(l).data(), saved.Level(l).size() * sizeof(Overview::Bin)) == 0);
+    }
+
+    // A file cut short, or with anything after the bins, isn't taken
+    FILE *fp = fopen(FILE_NAME, "ab");
+    fputc(0, fp);
+    fclose(fp);
+    CHECK(loaded.Load(FILE_NAME) < 0);
+    CHECK(loaded.Empty());
+    CHECK(loaded.Load("no/such/file") < 0);
+    remove(FILE_NAME);
+}
+
+static void TestRender()
+{
+    Overview overview;
+    char out[41];
+    overview.Render(out, 40, 0.5);
+    CHECK(strlen(out) == 40 && strspn(out, " ") == 40);
+
+    Fill(&overview);
+    overview.Render(out, 40, 0.5);
+    CHECK(strlen(out) == 40);
+    CHECK(out[20] == '|');
+    CHECK(out[39] == '@');
+    // Denser characters as the ramp gets louder
+    static const char ramp[] = " .:-=+*#%@";
+    for (unsigned int c = 1; c < 40; ++c) {
+        if (c != 20 && c != 21)
+            CHECK(strchr(ramp, out[c]) >= strchr(ramp, out[c - 1]));
+    }
+    CHECK(out[0] != '@');
+    overview.Render(out, 40, -1.0);
+    CHECK(strchr(out, '|') == nullptr);
+}
+
+int main()
+{
+    TestEncode();
+    TestLevels();
+    TestSaveLoad();
+    TestRender();
+    return s_failures;
+}
@@ -0,0 +1,105 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the Requantizer.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Requantizer.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static void TestParse()
+{
+    Requantizer::Dither dither;
+    CHECK(Requantizer::ParseDither("none", &dither) == 0 && dither == Requantizer::NONE);
+    CHECK(Requantizer::ParseDither("tpdf", &dither) == 0 && dither == Requantizer::TPDF);
+    CHECK(Requantizer::ParseDither("shaped", &dither) == 0 && dither == Requantizer::SHAPED);
+    CHECK(Requantizer::ParseDither("rect", &dither) < 0);
+}
+
+// Undithered, values round to the nearest code and clip at full scale
+static void TestRounding()
+{
+    const float in[] = { 0.0f, 0.5f, -0.5f, -1.0f, 1.0f, 1.5f, -1.5f, 1.4f / 32768.0f, 1.6f / 32768.0f };
+    const int16_t expected[] = { 0, 16384, -16384, -32768, 32767, 32767, -32768, 1, 2 };
+    const size_t n = sizeof(in) / sizeof(in[0]);
+
+    Requantizer q16(1, 16, Requantizer::NONE);
+    CHECK(q16.FrameBytes() == 2);
+    int16_t out16[n];
+    q16.Process(in, n, out16);
+    for (size_t i = 0; i < n; ++i)
+        CHECK(out16[i] == expected[i]);
+
+    Requantizer q32(1, 32, Requantizer::NONE);
+    int32_t out32[n];
+    q32.Process(in, n, out32);
+    CHECK(out32[1] == 1 << 30);
+    CHECK(out32[3] == INT32_MIN);
+    CHECK(out32[4] == INT32_MAX);
+}
+
+// 24-bit samples are packed in 3 bytes, little-endian
+static void TestPacking()
+{
+    Requantizer q(2, 24, Requantizer::NONE);
+    CHECK(q.FrameBytes() == 6);
+    const float in[] = { 0.5f, -1.0f / 8388608.0f };
+    uint8_t out[6];
+    q.Process(in, 1, out);
+    const uint8_t expected[] = { 0x00, 0x00, 0x40, 0xff, 0xff, 0xff };
+    CHECK(memcmp(out, expected, sizeof(out)) == 0);
+}
+
+// Dither keeps the error within 1.5 LSB and unbiased, and doesn't leave
+// quiet passages quantized to one code
+static void TestDither(Requantizer::Dither dither, double maxError)
+{
+    const size_t n = 1 << 16;
+    std::vector<float> in(n);
+    for (size_t i = 0; i < n; ++i)
+        in[i] = (float)(0.25 / 32768.0 * std::sin(i * 0.01));
+    std::vector<int16_t> out(n);
+    Requantizer q(1, 16, dither);
+    q.Process(in.data(), n, out.data());
+
+    double sum = 0.0, worst = 0.0;
+    bool varied = false;
+    for (size_t i = 0; i < n; ++i) {
+        const double e = out[i] - in[i] * 32768.0;
+        sum += e;
+        worst = std::max(worst, std::fabs(e));
+        varied |= out[i] != 0;
+    }
+    CHECK(varied);
+    CHECK(worst <= maxError);
+    CHECK(std::fabs(sum / n) < 0.05);
+}
+
+int main()
+{
+    TestParse();
+    TestRounding();
+    TestPacking();
+    TestDither(Requantizer::TPDF, 1.5);
+    // The error fed back, bounded to 2 LSB per tap, can add up to 5.4 LSB
+    TestDither(Requantizer::SHAPED, 1.5 + 2.0 * (1.623 + 0.982 + 0.109));
+    return s_failures;
+}
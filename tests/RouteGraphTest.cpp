@@ -0,0 +1,157 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of RouteGraph's parsing and checks.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "RouteGraph.h"
+
+static const std::map<std::string, std::string> s_vars = { { "producer", "1234" }, { "sink", "5678" } };
+
+static int Parse(const char *text, const std::set<std::string> &flags = {}, std::string *error = nullptr,
+    RouteGraph *graph = nullptr)
+{
+    RouteGraph local("");
+    std::string why;
+    return (graph ? graph : &local)->Parse(text, flags, s_vars, error ? error : &why);
+}
+
+static void TestValid()
+{
+    RouteGraph graph(".so");
+    std::string error;
+    CHECK(Parse("block in libblkstreamin $producer  # the file\n"
+                "block gain libblkgain\n"
+                "block out libblkfadeout\n"
+                "link in gain\n"
+                "link gain out channels=2 format=native\n"
+                "param gain 0 0 0.5\n"
+                "output out\n", {}, &error, &graph) == 0);
+    CHECK(error.empty());
+    CHECK(graph.Has("gain"));
+    CHECK(!graph.Has("stretch"));
+    CHECK(graph.Uses("producer") == 1);
+    CHECK(graph.Uses("sink") == 0);
+    CHECK(graph.Block("gain") == nullptr);      // not built yet
+    CHECK(graph.Library("gain").empty());
+}
+
+static void TestConditions()
+{
+    const char *text =
+        "block in libblkstreamin $producer\n"
+        "block out libblkfadeout\n"
+        "save: block saver libblkstreamout $sink\n"
+        "save: block dup libblkduplicator\n"
+        "!save: link in out\n"
+        "save: link in dup\n"
+        "save: link dup.0 out\n"
+        "save: link dup.1 saver\n"
+        "output out\n";
+    RouteGraph graph("");
+    std::string error;
+    CHECK(Parse(text, {}, &error, &graph) == 0);
+    CHECK(!graph.Has("saver") && graph.Uses("sink") == 0);
+    CHECK(Parse(text, { "save" }, &error, &graph) == 0);
+    CHECK(graph.Has("saver") && graph.Uses("sink") == 1);
+}
+
+static void TestErrors()
+{
+    static const struct {
+        const char *text;
+        const char *error;
+    } cases[] = {
+        { "", "no blocks" },
+        { "block in libblkstreamin\n", "no output" },
+        { "block in libblkstreamin\nblock in libblkgain\n", "line 2: block in defined twice" },
+        { "block a.b libblkgain\n", "line 1: block names can't have '.'" },
+        { "block in libblkstreamin $nothing\n", "line 1: unknown variable $nothing" },
+        { "frob in\n", "line 1: unknown statement frob" },
+        { "!x:\n", "line 1: nothing after the condition" },
+        { "block in lib\nlink in out\n", "line 2: unknown block out" },
+        { "block in lib\nblock out lib\nlink in.x out\n", "line 3: invalid port in in.x" },
+        { "block in lib\nblock out lib\nlink in out channels=0\n", "line 3: invalid channels=0" },
+        { "block in lib\nblock out lib\nlink in out format=s8\n", "line 3: unknown link option format=s8" },
+        { "block in lib\nblock a lib\nblock b lib\nlink in a\nlink in b\n", "line 5: in linked twice" },
+        { "block in lib\nparam in x\n", "line 2: invalid parameter ID x" },
+        { "block in lib\nblock out lib\nlink in out\noutput out\noutput out\n", "line 5: output given twice" },
+        { "block in lib\nblock out lib\nlink in out\noutput in\n", "the output of in is linked as well" },
+        { "block in lib\nblock out lib\nblock lone lib\nlink in out\noutput out\n", "block lone isn't linked" },
+        { "block in lib\noutput in\n", "nothing reaches the output" },
+    };
+    for (const auto &c : cases) {
+        std::string error;
+        CHECK(Parse(c.text, {}, &error) < 0);
+        if (error != c.error)
+            fprintf(stderr, "expected \"%s\", got \"%s\"\n", c.error, error.c_str());
+        CHECK(error == c.error);
+    }
+}
+
+static void TestCycles()
+{
+    std::string error;
+    CHECK(Parse("block in lib\n"
+                "block mix lib\n"
+                "block delay lib\n"
+                "block out lib\n"
+                "link in mix.0\n"
+                "link mix.0 delay\n"
+                "link delay mix.1\n"
+                "link mix.1 out\n"
+                "output out\n", {}, &error) < 0);
+    CHECK(error == "block mix is linked in a cycle");
+
+    // Diamonds aren't cycles
+    CHECK(Parse("block in lib\n"
+                "block dup lib\n"
+                "block a lib\n"
+                "block b lib\n"
+                "block mix lib\n"
+                "link in dup\n"
+                "link dup.0 a\n"
+                "link dup.1 b\n"
+                "link a mix.0\n"
+                "link b mix.1\n"
+                "output mix\n", {}, &error) == 0);
+}
+
+static void TestUses()
+{
+    RouteGraph graph("");
+    std::string error;
+    CHECK(Parse("block in libblkstreamin $producer\n"
+                "block in2 libblkstreamin $producer\n"
+                "block mix lib\n"
+                "link in mix.0\n"
+                "link in2 mix.1\n"
+                "output mix\n", {}, &error, &graph) == 0);
+    CHECK(graph.Uses("producer") == 2);
+}
+
+int main()
+{
+    TestValid();
+    TestConditions();
+    TestErrors();
+    TestCycles();
+    TestUses();
+    return s_failures;
+}
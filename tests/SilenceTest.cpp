@@ -0,0 +1,129 @@
+/* kplay - A WAV File Player with Real-Time Sound Tuning
+ *
+ * Unit tests of the SilenceStage's trimming and gap skipping.
+ *
+ * Copyright (C) 2022  Kui Wang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Check.h"
+#include "Silence.h"
+#include <cmath>
+
+static const unsigned int RATE = 48000;
+
+// Stereo sections of silence and of a -20 dBFS tone, given as seconds with
+// sound and without, alternating and starting with silence
+class Sections : public Stage {
+public:
+    Sections(std::initializer_list<double> seconds) : Stage(nullptr)
+    {
+        for (double s : seconds)
+            m_ends.push_back((m_ends.empty() ? 0 : m_ends.back()) + (uint64_t)(s * RATE));
+    }
+
+    uint64_t Frames() const
+    {
+        return m_ends.back();
+    }
+
+    virtual int Pull(float *out, lark::samples_t frames) override
+    {
+        lark::samples_t n = 0;
+        for (; n < frames && m_pos < Frames(); ++n, ++m_pos) {
+            size_t section = 0;
+            while (m_pos >= m_ends[section])
+                ++section;
+            // Under -60 dBFS counts as silence
+            const float v = (section & 1) ? 0.1f * (float)std::sin(0.05 * m_pos) : 1e-4f;
+            out[2 * n] = v;
+            out[2 * n + 1] = -v;
+        }
+        return n ? (int)n : lark::E_EOF;
+    }
+    virtual void Reset() override
+    {
+        m_pos = 0;
+    }
+
+private:
+    std::vector<uint64_t> m_ends;
+    uint64_t m_pos = 0;
+};
+
+static uint64_t PullAll(Stage *stage)
+{
+    std::vector<float> out(2 * 1000);
+    uint64_t frames = 0;
+    int ret;
+    while ((ret = stage->Pull(out.data(), 1000)) > 0)
+        frames += ret;
+    return frames;
+}
+
+// Only what comes before the first sound is dropped without skipGaps
+static void TestLeading()
+{
+    Sections source({ 1.0, 0.5, 3.0, 0.5, 0.2 });
+    SilenceStage silence(&source, 2, RATE, -60.0, RATE / 2, false);
+    CHECK(PullAll(&silence) == source.Frames() - RATE);
+    CHECK(silence.Skipped() == RATE);
+
+    // Everything again once reset
+    silence.Reset();
+    CHECK(PullAll(&silence) == source.Frames() - RATE);
+}
+
+// Long gaps shrink to minFrames, short ones stay as they are
+static void TestGaps()
+{
+    Sections source({ 0.5, 0.5, 3.0, 0.5, 0.3, 0.5 });
+    SilenceStage silence(&source, 2, RATE, -60.0, RATE / 2, true);
+    const uint64_t skipped = RATE / 2 + (3 * RATE - RATE / 2);
+    CHECK(PullAll(&silence) == source.Frames() - skipped);
+    CHECK(silence.Skipped() == skipped);
+}
+
+// The trailing silence goes once SetEnd() is given where the sound ends
+static void TestEnd()
+{
+    Sections source({ 0.0, 2.0, 1.5 });
+    Overview overview;
+    std::vector<float> frames(2 * 1000);
+    int ret;
+    while ((ret = source.Pull(frames.data(), 1000)) > 0)
+        overview.Add(frames.data(), ret, 2);
+    overview.Finish();
+    source.Reset();
+
+    const uint64_t end = SilenceStage::LastSound(overview, -60.0);
+    CHECK(end >= 2 * RATE && end < 2 * RATE + Overview::BIN_FRAMES);
+    SilenceStage silence(&source, 2, RATE, -60.0, RATE / 2, false);
+    silence.SetEnd(end);
+    CHECK(PullAll(&silence) == end);
+
+    // Nothing reaches -10 dBFS
+    CHECK(SilenceStage::LastSound(overview, -10.0) == 0);
+    CHECK(SilenceStage::LastSound(Overview(), -60.0) == 0);
+}
+
+int main()
+{
+    TestLeading();
+    TestGaps();
+    TestEnd();
+    return s_failures;
+}